@@ -0,0 +1,202 @@
+#include "BinaryLog.hpp"
+
+#include <sstream>
+#include <vector>
+
+#include "Logger.hpp"
+
+namespace Fetcko {
+namespace {
+// Bounds-checked reads over a record. Records may
+// have been truncated by the encoder, so running out
+// of bytes just ends the message early.
+class Reader {
+public:
+	Reader(const char *data, std::size_t size) : data(data), size(size) {}
+
+	template<typename T>
+	bool Get(T &t) {
+		if (offset + sizeof(T) > size) return false;
+
+		std::memcpy(&t, data + offset, sizeof(T));
+		offset += sizeof(T);
+
+		return true;
+	}
+
+	bool GetString(std::string_view &string) {
+		uint16_t length = 0;
+		if (!Get(length)) return false;
+
+		length = static_cast<uint16_t>(std::min<std::size_t>(length, size - offset));
+		string = std::string_view(data + offset, length);
+		offset += length;
+
+		return true;
+	}
+
+	bool GetBytes(const char *&bytes, std::size_t count) {
+		if (offset + count > size) return false;
+
+		bytes = data + offset;
+		offset += count;
+
+		return true;
+	}
+
+private:
+	const char *data;
+	std::size_t size;
+	std::size_t offset = 0;
+};
+
+
+struct Fields {
+	int64_t nanoseconds = 0;
+	uint8_t level = 0;
+	uint8_t count = 0;
+	uint64_t address = 0;
+	std::string_view className;
+	std::string_view name;
+	const char *types = nullptr;
+};
+
+// Reads the fixed fields, then hands each argument to
+// onArg as whatever type it was encoded as
+template<typename F>
+bool Visit(const char *data, std::size_t size, Fields &fields, F &&onArg) {
+	Reader reader(data, size);
+
+	if (!reader.Get(fields.nanoseconds) ||
+		!reader.Get(fields.level) ||
+		!reader.Get(fields.count) ||
+		!reader.Get(fields.address) ||
+		!reader.GetString(fields.className) ||
+		!reader.GetString(fields.name) ||
+		!reader.GetBytes(fields.types, fields.count))
+		return false;
+
+	for (uint8_t i = 0; i < fields.count; ++i) {
+		bool ok = true;
+
+		switch (static_cast<BinaryLog::ArgType>(fields.types[i])) {
+			case BinaryLog::ArgType::Bool: {
+				bool value = false;
+				if ((ok = reader.Get(value))) onArg(value);
+				break;
+			}
+			case BinaryLog::ArgType::Char: {
+				char value = 0;
+				if ((ok = reader.Get(value))) onArg(value);
+				break;
+			}
+			case BinaryLog::ArgType::Int: {
+				int64_t value = 0;
+				if ((ok = reader.Get(value))) onArg(value);
+				break;
+			}
+			case BinaryLog::ArgType::UInt: {
+				uint64_t value = 0;
+				if ((ok = reader.Get(value))) onArg(value);
+				break;
+			}
+			case BinaryLog::ArgType::Double: {
+				double value = 0;
+				if ((ok = reader.Get(value))) onArg(value);
+				break;
+			}
+			case BinaryLog::ArgType::String: {
+				std::string_view value;
+				if ((ok = reader.GetString(value))) onArg(value);
+				break;
+			}
+			default:
+				ok = false;
+		}
+
+		if (!ok) break;
+	}
+
+	return true;
+}
+}
+
+uint8_t BinaryLog::Format(const char *data, std::size_t size, std::ostream &out) {
+	// The header has to come before the arguments,
+	// so format those into a side stream first
+	thread_local std::ostringstream message;
+	message.str({});
+	message.clear();
+
+	Fields fields;
+	if (!Visit(data, size, fields, [](const auto &value) { message << value; }))
+		return fields.level;
+
+	Logger::FormatHeader(
+		out,
+		static_cast<Logger::Level>(fields.level),
+		fields.nanoseconds,
+		fields.className,
+		fields.name,
+		reinterpret_cast<const void *>(static_cast<uintptr_t>(fields.address))
+	);
+
+	out << message.str();
+
+	return fields.level;
+}
+
+uint8_t BinaryLog::FormatJson(const char *data, std::size_t size, JsonWriter &writer) {
+	thread_local std::ostringstream message;
+	message.str({});
+	message.clear();
+
+	Fields fields;
+	if (!Visit(data, size, fields, [](const auto &value) { message << value; }))
+		return fields.level;
+
+	writer.BeginObject();
+	Logger::FormatJsonHeader(
+		writer,
+		static_cast<Logger::Level>(fields.level),
+		fields.nanoseconds,
+		fields.className,
+		fields.name,
+		reinterpret_cast<const void *>(static_cast<uintptr_t>(fields.address))
+	);
+	writer.Field("msg", message.str());
+	writer.EndObject();
+
+	return fields.level;
+}
+
+std::size_t BinaryLog::Decode(std::istream &in, std::ostream &out) {
+	std::array<char, Magic.size()> magic {};
+	uint8_t version = 0;
+
+	in.read(magic.data(), magic.size());
+	in.read(reinterpret_cast<char *>(&version), sizeof(version));
+
+	if (!in || magic != Magic || version != Version) return 0;
+
+	std::size_t count = 0;
+	std::vector<char> data;
+
+	while (true) {
+		uint32_t size = 0;
+		if (!in.read(reinterpret_cast<char *>(&size), sizeof(size)) || size > MaxRecordSize)
+			break;
+
+		data.resize(size);
+		if (!in.read(data.data(), size))
+			break;
+
+		Format(data.data(), data.size(), out);
+		out << '\n';
+
+		++count;
+	}
+
+	return count;
+}
+}
\ No newline at end of file
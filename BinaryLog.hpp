@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "StructuredLog.hpp"
+
+namespace Fetcko {
+// NanoLog-style deferred logging.
+// Instead of formatting on the calling thread, a Log call copies
+// its header fields and raw argument bytes into a BinaryLog::Record.
+// The record is self-describing (each argument is tagged with its
+// type), so it can be formatted later by Logger's background writer
+// or written to disk as-is and decoded offline with BinaryLog::Decode.
+//
+// Record layout (all integers little-endian as written by the host):
+//	int64	nanoseconds since the system_clock epoch
+//	uint8	level
+//	uint8	argument count
+//	uint64	object address
+//	string	class name
+//	string	instance name
+//	uint8[]	argument types
+//	...		argument values
+// where a string is a uint16 length followed by that many bytes.
+class BinaryLog {
+public:
+	enum class ArgType : uint8_t {
+		Bool,
+		Char,
+		Int,
+		UInt,
+		Double,
+		String
+	};
+
+	static constexpr std::size_t MaxRecordSize = 496;
+
+	struct Record {
+		uint32_t size = 0;
+		std::array<char, MaxRecordSize> data;
+	};
+
+	// Files written by Logger::StartDeferred start with this
+	static constexpr std::array<char, 4> Magic = { 'F', 'L', 'O', 'G' };
+	static constexpr uint8_t Version = 1;
+
+	template<typename T>
+	static constexpr bool IsStringLike =
+		std::is_same<T, std::string>::value ||
+		std::is_same<T, std::string_view>::value ||
+		std::is_same<T, std::filesystem::path>::value ||
+		std::is_same<T, const char *>::value ||
+		std::is_same<T, char *>::value;
+
+	template<typename T>
+	static constexpr bool IsEncodable = std::is_arithmetic<T>::value || IsStringLike<T>;
+
+	template<typename... Args>
+	static constexpr bool AllEncodable = (IsEncodable<std::decay_t<Args>> && ...);
+
+	// Streamed as characters, not numbers, so int8_t and
+	// uint8_t are too (being signed and unsigned char)
+	template<typename T>
+	static constexpr bool IsCharacter =
+		std::is_same<T, char>::value ||
+		std::is_same<T, signed char>::value ||
+		std::is_same<T, unsigned char>::value;
+
+	template<typename T>
+	static constexpr ArgType TypeOf() {
+		if constexpr (std::is_same<T, bool>::value) return ArgType::Bool;
+		else if constexpr (IsCharacter<T>) return ArgType::Char;
+		else if constexpr (std::is_floating_point<T>::value) return ArgType::Double;
+		else if constexpr (std::is_integral<T>::value && std::is_signed<T>::value) return ArgType::Int;
+		else if constexpr (std::is_integral<T>::value) return ArgType::UInt;
+		else return ArgType::String;
+	}
+
+	template<typename T>
+	static std::size_t ArgSize(const T &t) {
+		using U = std::decay_t<T>;
+
+		if constexpr (std::is_same<U, std::filesystem::path>::value) {
+			if constexpr (std::is_same<std::filesystem::path::value_type, char>::value)
+				return sizeof(uint16_t) + t.native().size();
+			else
+				return sizeof(uint16_t) + t.u8string().size();
+		} else if constexpr (IsStringLike<U>) {
+			return sizeof(uint16_t) + std::string_view(t).size();
+		} else if constexpr (TypeOf<U>() == ArgType::Char) {
+			return sizeof(char);
+		} else if constexpr (TypeOf<U>() == ArgType::Double) {
+			return sizeof(double);
+		} else if constexpr (TypeOf<U>() == ArgType::Int || TypeOf<U>() == ArgType::UInt) {
+			return sizeof(uint64_t);
+		} else {
+			return sizeof(U);
+		}
+	}
+
+	// One per distinct argument list, built at compile time
+	template<typename... Args>
+	struct Descriptor {
+		static constexpr std::array<ArgType, sizeof...(Args)> Types = { TypeOf<std::decay_t<Args>>()... };
+	};
+
+	// Writes into a Record, silently truncating strings
+	// once the record is full.
+	class Encoder {
+	public:
+		explicit Encoder(Record &record) : record(record) { record.size = 0; }
+
+		template<typename T>
+		void Put(T t) {
+			static_assert(std::is_trivially_copyable<T>::value);
+
+			if (record.size + sizeof(T) > record.data.size()) return;
+
+			std::memcpy(record.data.data() + record.size, &t, sizeof(T));
+			record.size += sizeof(T);
+		}
+
+		void PutBytes(const void *bytes, std::size_t size) {
+			size = std::min(size, record.data.size() - record.size);
+
+			std::memcpy(record.data.data() + record.size, bytes, size);
+			record.size += static_cast<uint32_t>(size);
+		}
+
+		void PutString(std::string_view string) {
+			const auto available = record.data.size() - std::min<std::size_t>(record.size + sizeof(uint16_t), record.data.size());
+			const auto length = static_cast<uint16_t>(std::min(string.size(), available));
+
+			Put(length);
+			PutBytes(string.data(), length);
+		}
+
+		// T may be a char array, when a literal is passed by reference
+		template<typename T>
+		void PutArg(const T &t) {
+			using U = std::decay_t<T>;
+
+			if constexpr (std::is_same<U, std::filesystem::path>::value) {
+				if constexpr (std::is_same<std::filesystem::path::value_type, char>::value)
+					PutString(t.native());
+				else
+					PutString(t.u8string());
+			} else if constexpr (IsStringLike<U>) {
+				PutString(t);
+			} else if constexpr (TypeOf<U>() == ArgType::Char) {
+				Put(static_cast<char>(t));
+			} else if constexpr (TypeOf<U>() == ArgType::Double) {
+				Put(static_cast<double>(t));
+			} else if constexpr (TypeOf<U>() == ArgType::Int) {
+				Put(static_cast<int64_t>(t));
+			} else if constexpr (TypeOf<U>() == ArgType::UInt) {
+				Put(static_cast<uint64_t>(t));
+			} else {
+				Put(t);
+			}
+		}
+
+	private:
+		Record &record;
+	};
+
+	template<typename... Args>
+	static void Encode(
+		Record &record,
+		int64_t nanoseconds,
+		uint8_t level,
+		const void *address,
+		std::string_view className,
+		std::string_view name,
+		const Args &... args
+	) {
+		const auto &types = Descriptor<Args...>::Types;
+
+		Encoder encoder(record);
+		encoder.Put(nanoseconds);
+		encoder.Put(level);
+		encoder.Put(static_cast<uint8_t>(types.size()));
+		encoder.Put(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(address)));
+		encoder.PutString(className);
+		encoder.PutString(name);
+		encoder.PutBytes(types.data(), types.size());
+		(encoder.PutArg(args), ...);
+	}
+
+	// What Encode would take, so callers can tell whether it'd
+	// fit in a Record before it's cut short
+	template<typename... Args>
+	static std::size_t EncodedSize(std::string_view className, std::string_view name, const Args &... args) {
+		return
+			sizeof(int64_t) + sizeof(uint8_t) + sizeof(uint8_t) + sizeof(uint64_t) +
+			sizeof(uint16_t) + className.size() +
+			sizeof(uint16_t) + name.size() +
+			sizeof...(Args) +
+			(ArgSize(args) + ... + 0);
+	}
+
+	// Just the time or the level, without decoding the rest
+	static int64_t TimeOf(const Record &record) {
+		int64_t ret = 0;
+		if (record.size >= sizeof(ret))
+			std::memcpy(&ret, record.data.data(), sizeof(ret));
+		return ret;
+	}
+
+	static uint8_t LevelOf(const Record &record) {
+		return record.size > sizeof(int64_t) ? static_cast<uint8_t>(record.data[sizeof(int64_t)]) : 0;
+	}
+
+	// Formats one record exactly as the synchronous
+	// logger would have. Returns the record's level.
+	static uint8_t Format(const char *data, std::size_t size, std::ostream &out);
+
+	// The same, as one JSON object like Logger's JSON-lines output
+	static uint8_t FormatJson(const char *data, std::size_t size, JsonWriter &writer);
+
+	// Reads a file written by Logger::StartDeferred and
+	// writes it out as text. Returns the number of records.
+	static std::size_t Decode(std::istream &in, std::ostream &out);
+};
+}
\ No newline at end of file
@@ -0,0 +1,293 @@
+#include "CompressedLog.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Hash.hpp"
+
+namespace Fetcko {
+namespace {
+constexpr std::size_t MinMatch = 4;
+constexpr std::size_t MaxOffset = 0xFFFF;
+constexpr int HashBits = 14;
+
+// Matches end this far short of the end of the block,
+// so reading four bytes at a time never runs off it
+constexpr std::size_t TailLiterals = 8;
+
+// Set on a block's payload size when it's stored as-is
+constexpr uint32_t Stored = 0x80000000u;
+
+uint32_t Read32(const char *p) {
+	uint32_t ret;
+	std::memcpy(&ret, p, sizeof(ret));
+	return ret;
+}
+
+uint32_t HashOf(uint32_t value) {
+	return (value * 2654435761u) >> (32 - HashBits);
+}
+
+char *PutLength(char *out, std::size_t length) {
+	for (; length >= 255; length -= 255)
+		*out++ = static_cast<char>(255);
+
+	*out++ = static_cast<char>(length);
+	return out;
+}
+
+// A token (literal length << 4 | match length - MinMatch, each
+// topping out at 15 and carrying on in bytes after), the literals,
+// then the match's offset, unless it's the last sequence
+char *PutSequence(char *out, const char *literals, std::size_t literalLength, std::size_t offset, std::size_t matchLength) {
+	const auto matchCode = matchLength ? matchLength - MinMatch : 0;
+
+	*out++ = static_cast<char>((std::min<std::size_t>(literalLength, 15) << 4) | std::min<std::size_t>(matchCode, 15));
+	if (literalLength >= 15) out = PutLength(out, literalLength - 15);
+
+	std::memcpy(out, literals, literalLength);
+	out += literalLength;
+
+	if (matchLength) {
+		*out++ = static_cast<char>(offset & 0xFF);
+		*out++ = static_cast<char>(offset >> 8);
+		if (matchCode >= 15) out = PutLength(out, matchCode - 15);
+	}
+
+	return out;
+}
+
+template<typename T>
+void Append(std::string &out, T t) {
+	out.append(reinterpret_cast<const char *>(&t), sizeof(t));
+}
+}
+
+void CompressedLog::Compress(const char *data, std::size_t size, std::string &out) {
+	out.resize(MaxCompressedSize(size));
+	auto *cursor = out.data();
+
+	// Where each hash of four bytes was last seen
+	std::array<uint32_t, 1 << HashBits> table {};
+
+	std::size_t anchor = 0;
+	std::size_t i = 0;
+	const auto limit = size > TailLiterals ? size - TailLiterals : 0;
+
+	while (i < limit) {
+		const auto value = Read32(data + i);
+		auto &slot = table[HashOf(value)];
+		const std::size_t candidate = slot;
+		slot = static_cast<uint32_t>(i);
+
+		if (candidate < i && i - candidate <= MaxOffset && Read32(data + candidate) == value) {
+			// Take in any literals just before that match too
+			auto start = i;
+			auto from = candidate;
+			while (start > anchor && from > 0 && data[start - 1] == data[from - 1]) {
+				--start;
+				--from;
+			}
+
+			auto length = i - start + MinMatch;
+			while (start + length < limit && data[from + length] == data[start + length])
+				++length;
+
+			cursor = PutSequence(cursor, data + anchor, start - anchor, start - from, length);
+			i = anchor = start + length;
+		} else {
+			// Speed up through stretches that don't compress
+			i += 1 + ((i - anchor) >> 6);
+		}
+	}
+
+	cursor = PutSequence(cursor, data + anchor, size - anchor, 0, 0);
+	out.resize(static_cast<std::size_t>(cursor - out.data()));
+}
+
+bool CompressedLog::Decompress(const char *data, std::size_t size, char *out, std::size_t outSize) {
+	const auto *in = reinterpret_cast<const uint8_t *>(data);
+	const auto *inEnd = in + size;
+	std::size_t written = 0;
+
+	const auto getLength = [&](std::size_t &length) {
+		uint8_t byte = 0;
+		do {
+			if (in == inEnd) return false;
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+
+		return true;
+	};
+
+	while (in < inEnd) {
+		const auto token = *in++;
+
+		std::size_t literals = token >> 4;
+		if (literals == 15 && !getLength(literals)) return false;
+		if (literals > static_cast<std::size_t>(inEnd - in) || literals > outSize - written) return false;
+
+		std::memcpy(out + written, in, literals);
+		in += literals;
+		written += literals;
+
+		// Only the last sequence has no match
+		if (in == inEnd) break;
+		if (inEnd - in < 2) return false;
+
+		const std::size_t offset = in[0] | (static_cast<std::size_t>(in[1]) << 8);
+		in += 2;
+
+		std::size_t length = token & 0xF;
+		if (length == 15 && !getLength(length)) return false;
+		length += MinMatch;
+
+		if (!offset || offset > written || length > outSize - written) return false;
+
+		auto *to = out + written;
+		const auto *from = to - offset;
+
+		// Overlapping copies repeat what they've just written
+		if (offset >= length) {
+			std::memcpy(to, from, length);
+		} else {
+			for (std::size_t i = 0; i < length; ++i)
+				to[i] = from[i];
+		}
+
+		written += length;
+	}
+
+	return written == outSize;
+}
+
+void CompressedLog::EncodeBlock(const char *data, std::size_t size, std::string &out, std::string &scratch) {
+	Compress(data, size, scratch);
+
+	const auto compressed = scratch.size() < size;
+	const auto *payload = compressed ? scratch.data() : data;
+	const auto payloadSize = compressed ? scratch.size() : size;
+
+	out.append(BlockMarker.data(), BlockMarker.size());
+	Append(out, static_cast<uint32_t>(size));
+	Append(out, static_cast<uint32_t>(payloadSize) | (compressed ? 0 : Stored));
+	Append(out, hash_32_fnv1a_const(payload, payloadSize));
+	out.append(payload, payloadSize);
+}
+
+CompressedLog::Reader::Reader(std::istream &in) : in(in) {
+	std::array<char, Magic.size()> magic {};
+	uint8_t version = 0;
+
+	in.read(magic.data(), magic.size());
+	in.read(reinterpret_cast<char *>(&version), sizeof(version));
+
+	valid = in && magic == Magic && version == Version;
+}
+
+bool CompressedLog::Reader::FindMarker() {
+	std::array<char, BlockMarker.size()> window {};
+	if (!in.read(window.data(), window.size())) return false;
+
+	while (window != BlockMarker) {
+		char c;
+		if (!in.get(c)) return false;
+
+		std::memmove(window.data(), window.data() + 1, window.size() - 1);
+		window.back() = c;
+	}
+
+	return true;
+}
+
+bool CompressedLog::Reader::NextBlock(std::string &text) {
+	if (!valid) return false;
+
+	while (FindMarker()) {
+		const auto blockStart = in.tellg();
+
+		uint32_t size = 0;
+		uint32_t stored = 0;
+		uint32_t hash = 0;
+
+		if (!in.read(reinterpret_cast<char *>(&size), sizeof(size)) ||
+			!in.read(reinterpret_cast<char *>(&stored), sizeof(stored)) ||
+			!in.read(reinterpret_cast<char *>(&hash), sizeof(hash))) {
+			++skipped;
+			return false;
+		}
+
+		const auto isStored = (stored & Stored) != 0;
+		const std::size_t payloadSize = stored & ~Stored;
+
+		bool ok =
+			size <= MaxBlockSize &&
+			payloadSize <= MaxCompressedSize(size) &&
+			(!isStored || payloadSize == size);
+
+		if (ok) {
+			payload.resize(payloadSize);
+
+			// Cut off mid-block; there's nothing after it
+			if (!in.read(payload.data(), static_cast<std::streamsize>(payloadSize))) {
+				++skipped;
+				return false;
+			}
+
+			ok = hash_32_fnv1a_const(payload.data(), payload.size()) == hash;
+		}
+
+		if (ok) {
+			if (isStored) {
+				text = payload;
+			} else {
+				text.resize(size);
+				ok = Decompress(payload.data(), payload.size(), text.data(), text.size());
+			}
+		}
+
+		if (ok) return true;
+
+		// Look for the next marker from just after this one,
+		// since this one's sizes can't be trusted
+		++skipped;
+		if (blockStart != std::streampos(-1)) {
+			in.clear();
+			in.seekg(blockStart);
+		}
+	}
+
+	return false;
+}
+
+bool CompressedLog::Reader::NextLine(std::string &line) {
+	while (position >= block.size()) {
+		if (!NextBlock(block)) return false;
+		position = 0;
+	}
+
+	auto end = block.find('\n', position);
+	if (end == std::string::npos) end = block.size();
+
+	line.assign(block, position, end - position);
+	position = end + 1;
+
+	return true;
+}
+
+std::size_t CompressedLog::Decode(std::istream &in, std::ostream &out) {
+	Reader reader(in);
+	if (!reader.IsValid()) return 0;
+
+	std::size_t count = 0;
+	std::string text;
+
+	while (reader.NextBlock(text)) {
+		out.write(text.data(), static_cast<std::streamsize>(text.size()));
+		++count;
+	}
+
+	return count;
+}
+}
\ No newline at end of file
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+namespace Fetcko {
+// Log text compressed in independent blocks, written by
+// CompressedFileSink and read back with CompressedLog::Reader.
+//
+// The codec is LZ77 in the style of LZ4: a run of literals, then a
+// copy of up to 64KB back. There's no entropy coding, so it runs at
+// hundreds of MB/s, and log lines, which repeat a lot, still shrink
+// several times over.
+//
+// File layout (integers little-endian as written by the host):
+//	char[4]	Magic
+//	uint8	Version
+// then any number of blocks:
+//	char[4]	BlockMarker
+//	uint32	size of the text
+//	uint32	size of the payload; with the top bit set, the payload
+//			is the text as-is, because it didn't compress
+//	uint32	FNV-1a of the payload
+//	...		payload
+// Blocks share nothing, so a truncated or damaged one is skipped
+// and reading picks up again at the next BlockMarker.
+class CompressedLog {
+public:
+	static constexpr std::array<char, 4> Magic = { 'F', 'L', 'Z', 'B' };
+	static constexpr uint8_t Version = 1;
+
+	static constexpr std::array<char, 4> BlockMarker = { '\xF1', 'B', 'L', 'K' };
+
+	// Anything claiming to be bigger is taken as damage
+	static constexpr std::size_t MaxBlockSize = 64 * 1024 * 1024;
+
+	static constexpr std::size_t MaxCompressedSize(std::size_t size) {
+		return size + size / 255 + 16;
+	}
+
+	// Replaces out with the compressed form of data
+	static void Compress(const char *data, std::size_t size, std::string &out);
+
+	// out has to be exactly size bytes, as Compress was given.
+	// Returns false if data is damaged; never reads or writes
+	// outside either buffer.
+	static bool Decompress(const char *data, std::size_t size, char *out, std::size_t outSize);
+
+	// Appends a whole block, marker to payload, to out.
+	// scratch is reused between calls to save allocating.
+	static void EncodeBlock(const char *data, std::size_t size, std::string &out, std::string &scratch);
+
+	class Reader {
+	public:
+		// Checks the file header; see IsValid
+		explicit Reader(std::istream &in);
+
+		bool IsValid() const { return valid; }
+
+		// Replaces text with the next block's. Returns false at the end.
+		bool NextBlock(std::string &text);
+
+		// Without its newline
+		bool NextLine(std::string &line);
+
+		// Damaged or truncated blocks passed over so far
+		std::size_t GetSkipped() const { return skipped; }
+
+	private:
+		bool FindMarker();
+
+		std::istream &in;
+		bool valid = false;
+
+		std::string block;
+		std::size_t position = 0;
+
+		std::string payload;
+		std::size_t skipped = 0;
+	};
+
+	// Writes out every line of the file. Returns how many blocks were
+	// read, or 0 if in isn't one of ours.
+	static std::size_t Decode(std::istream &in, std::ostream &out);
+};
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "FlightRecorder.hpp"
+
+#include <csignal>
+#include <cstring>
+#include <iterator>
+
+#ifdef WIN32
+	#include <fcntl.h>
+	#include <io.h>
+	#include <sys/stat.h>
+#else
+	#include <cerrno>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+namespace Fetcko {
+namespace {
+constexpr int Signals[] = {
+	SIGSEGV,
+	SIGABRT,
+	SIGFPE,
+	SIGILL,
+#ifdef SIGBUS
+	SIGBUS
+#endif
+};
+
+std::atomic<FlightRecorder *> signalRecorder = nullptr;
+std::atomic<bool> signalDumped = false;
+std::atomic<bool> signalsInstalled = false;
+
+#ifdef WIN32
+using SignalHandler = void (*)(int);
+SignalHandler previous[std::size(Signals)];
+#else
+struct sigaction previous[std::size(Signals)];
+
+// Big enough for Dump's one record on the stack and then some
+alignas(16) char alternateStack[64 * 1024];
+#endif
+
+bool WriteAll(int file, const void *data, std::size_t size) {
+	const auto *bytes = static_cast<const char *>(data);
+
+	while (size) {
+#ifdef WIN32
+		const auto written = _write(file, bytes, static_cast<unsigned int>(size));
+#else
+		const auto written = write(file, bytes, size);
+		if (written == -1 && errno == EINTR) continue;
+#endif
+		if (written <= 0) return false;
+
+		bytes += written;
+		size -= static_cast<std::size_t>(written);
+	}
+
+	return true;
+}
+
+void HandleSignal(int signal) {
+	// Only the first thread to crash dumps
+	if (auto *recorder = signalRecorder.load(std::memory_order_acquire); recorder && !signalDumped.exchange(true))
+		recorder->Dump();
+
+	// Put back whoever had it before us and let them have it
+	for (std::size_t i = 0; i < std::size(Signals); ++i) {
+		if (Signals[i] != signal) continue;
+
+#ifdef WIN32
+		std::signal(signal, previous[i]);
+#else
+		sigaction(signal, &previous[i], nullptr);
+#endif
+	}
+
+	std::raise(signal);
+}
+}
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+FlightRecorder::FlightRecorder(std::size_t capacity, std::filesystem::path dumpPath) :
+	dumpPath(std::move(dumpPath)) {
+	std::size_t size = 2;
+	while (size < capacity) size <<= 1;
+
+	slots = std::make_unique<Slot[]>(size);
+	mask = size - 1;
+}
+
+bool FlightRecorder::Dump(const std::filesystem::path::value_type *path) const {
+#ifdef WIN32
+	const int file = _wopen(path, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+	const int file = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+
+	if (file == -1) return false;
+
+	bool ok =
+		WriteAll(file, BinaryLog::Magic.data(), BinaryLog::Magic.size()) &&
+		WriteAll(file, &BinaryLog::Version, sizeof(BinaryLog::Version));
+
+	const auto end = cursor.load(std::memory_order_acquire);
+	const auto begin = end > Capacity() ? end - Capacity() : 0;
+
+	// Copied out and checked before writing, like a seqlock reader
+	uint64_t words[RecordWords];
+	BinaryLog::Record record;
+
+	for (auto i = begin; ok && i < end; ++i) {
+		const auto &slot = slots[i & mask];
+
+		if (slot.sequence.load(std::memory_order_acquire) != i + 1) continue;
+
+		for (std::size_t j = 0; j < RecordWords; ++j)
+			words[j] = slot.words[j].load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		std::memcpy(&record, words, sizeof(record));
+
+		if (slot.sequence.load(std::memory_order_relaxed) != i + 1 || record.size > BinaryLog::MaxRecordSize)
+			continue;
+
+		ok =
+			WriteAll(file, &record.size, sizeof(record.size)) &&
+			WriteAll(file, record.data.data(), record.size);
+	}
+
+#ifdef WIN32
+	_close(file);
+#else
+	close(file);
+#endif
+
+	return ok;
+}
+
+void FlightRecorder::HandleSignals(FlightRecorder *recorder) {
+	signalRecorder.store(recorder, std::memory_order_release);
+
+	if (!recorder || signalsInstalled.exchange(true)) return;
+
+#ifdef WIN32
+	for (std::size_t i = 0; i < std::size(Signals); ++i)
+		previous[i] = std::signal(Signals[i], HandleSignal);
+#else
+	// Only covers this thread; any other thread that
+	// overflows its stack dies without a dump
+	stack_t stack {};
+	stack.ss_sp = alternateStack;
+	stack.ss_size = sizeof(alternateStack);
+	sigaltstack(&stack, nullptr);
+
+	struct sigaction action {};
+	action.sa_handler = HandleSignal;
+	action.sa_flags = SA_ONSTACK;
+	sigemptyset(&action.sa_mask);
+
+	for (std::size_t i = 0; i < std::size(Signals); ++i)
+		sigaction(Signals[i], &action, &previous[i]);
+#endif
+}
+}
\ No newline at end of file
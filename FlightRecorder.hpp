@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <type_traits>
+
+#include "BinaryLog.hpp"
+
+namespace Fetcko {
+// Keeps the most recent BinaryLog records in a preallocated ring,
+// overwriting the oldest, so that they can be written out after
+// something has gone wrong. Recording is a fetch_add to claim a
+// slot and a copy into it; nothing allocates or locks.
+//
+// Dumps are in the same format as Logger::StartDeferred's binary
+// file, oldest record first, and read back with BinaryLog::Decode.
+class FlightRecorder {
+public:
+	// capacity is in records and rounds up to a power of two.
+	// Each record takes a fixed sizeof(BinaryLog::Record) bytes.
+	FlightRecorder(std::size_t capacity, std::filesystem::path dumpPath);
+
+	// f fills the record, which is then copied into the claimed slot
+	template<typename F>
+	void Push(F &&f) {
+		BinaryLog::Record record;
+		f(record);
+
+		const auto index = cursor.fetch_add(1, std::memory_order_relaxed);
+		auto &slot = slots[index & mask];
+
+		// Zero marks the slot as being written, so a dump
+		// racing with us skips it rather than copying half
+		slot.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		// Only as many words as the record uses
+		const auto *bytes = reinterpret_cast<const char *>(&record);
+		const auto used = (offsetof(BinaryLog::Record, data) + record.size + 7) / 8;
+
+		for (std::size_t i = 0; i < used; ++i) {
+			uint64_t word = 0;
+			std::memcpy(&word, bytes + i * 8, i * 8 + 8 <= sizeof(record) ? 8 : sizeof(record) - i * 8);
+			slot.words[i].store(word, std::memory_order_relaxed);
+		}
+
+		slot.sequence.store(index + 1, std::memory_order_release);
+	}
+
+	// Async-signal-safe: only open, write and close, from and into
+	// memory that was allocated up front. Records being written while
+	// we dump are left out. Returns false if the file can't be created.
+	bool Dump() const { return Dump(dumpPath.c_str()); }
+	bool Dump(const std::filesystem::path::value_type *path) const;
+
+	std::size_t Capacity() const { return mask + 1; }
+	const std::filesystem::path &GetDumpPath() const { return dumpPath; }
+
+	// Dumps recorder on SIGSEGV, SIGABRT, SIGBUS, SIGFPE and SIGILL,
+	// then hands the signal on to whatever handled it before. On the
+	// calling thread they run on their own stack, so a stack overflow
+	// there still gets dumped. Passing nullptr stops dumping but
+	// leaves the handlers installed.
+	static void HandleSignals(FlightRecorder *recorder);
+
+private:
+	static_assert(std::is_trivially_copyable<BinaryLog::Record>::value, "records are copied as words");
+	static constexpr std::size_t RecordWords = (sizeof(BinaryLog::Record) + 7) / 8;
+
+	struct Slot {
+		// index + 1 of the record in it, 0 while it's being written
+		std::atomic<uint64_t> sequence = 0;
+
+		// The record, in atomic words so a dump racing
+		// a writer never reads a torn byte
+		std::array<std::atomic<uint64_t>, RecordWords> words {};
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::size_t mask = 0;
+
+	std::atomic<uint64_t> cursor = 0;
+
+	// Converted for the OS once, here, not in a signal handler
+	const std::filesystem::path dumpPath;
+};
+}
\ No newline at end of file
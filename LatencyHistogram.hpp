@@ -0,0 +1,145 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+namespace Fetcko {
+// A log-bucketed histogram of nanosecond durations, HDR style:
+// every power of two is split into SubBuckets linear buckets,
+// so any value is off by at most 1/SubBuckets (12.5%) from the
+// bucket it lands in, from single nanoseconds up to centuries.
+//
+// Recording is two relaxed fetch_adds, one for the bucket and one
+// for the running sum (so Mean is exact). Threads are spread over
+// a few cache-line-aligned shards so they don't all fight over
+// the same counters; Snapshot adds the shards back together.
+class LatencyHistogram {
+public:
+	static constexpr std::size_t SubBucketBits = 3;
+	static constexpr std::size_t SubBuckets = 1 << SubBucketBits;
+
+	// Values below SubBuckets get a bucket each, then
+	// SubBuckets for every power of two up to 2^63
+	static constexpr std::size_t Buckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+	static constexpr std::size_t Shards = 8;
+
+	struct Snapshot {
+		std::array<uint64_t, Buckets> counts {};
+		uint64_t count = 0;
+		uint64_t sum = 0;
+
+		// p in [0, 1]. Returns the upper bound of the bucket
+		// the pth value fell in, so it never under-reports.
+		uint64_t Percentile(double p) const {
+			if (!count) return 0;
+
+			const auto rank = static_cast<uint64_t>(p * static_cast<double>(count - 1)) + 1;
+
+			uint64_t seen = 0;
+			for (std::size_t i = 0; i < Buckets; ++i) {
+				if ((seen += counts[i]) >= rank)
+					return UpperBound(i);
+			}
+
+			return Max();
+		}
+
+		uint64_t Max() const {
+			for (auto i = Buckets; i-- > 0;) {
+				if (counts[i]) return UpperBound(i);
+			}
+
+			return 0;
+		}
+
+		uint64_t Mean() const { return count ? sum / count : 0; }
+	};
+
+	void Record(uint64_t nanoseconds) {
+		auto &shard = shards[ShardIndex()];
+		shard.counts[Index(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+		shard.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+	}
+
+	Snapshot Read() const {
+		Snapshot ret;
+
+		for (const auto &shard : shards) {
+			for (std::size_t i = 0; i < Buckets; ++i) {
+				const auto count = shard.counts[i].load(std::memory_order_relaxed);
+				ret.counts[i] += count;
+				ret.count += count;
+			}
+
+			ret.sum += shard.sum.load(std::memory_order_relaxed);
+		}
+
+		return ret;
+	}
+
+	// Not atomic as a whole; values recorded
+	// at the same time may or may not survive
+	void Reset() {
+		for (auto &shard : shards) {
+			for (auto &count : shard.counts)
+				count.store(0, std::memory_order_relaxed);
+
+			shard.sum.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	static std::size_t Index(uint64_t value) {
+		if (value < SubBuckets) return static_cast<std::size_t>(value);
+
+		const auto exponent = HighestBit(value);
+		const auto sub = (value >> (exponent - SubBucketBits)) & (SubBuckets - 1);
+
+		return (exponent - SubBucketBits + 1) * SubBuckets + static_cast<std::size_t>(sub);
+	}
+
+	static constexpr uint64_t LowerBound(std::size_t index) {
+		if (index < SubBuckets) return index;
+
+		const auto exponent = index / SubBuckets + SubBucketBits - 1;
+		const auto sub = index % SubBuckets;
+
+		return static_cast<uint64_t>(SubBuckets + sub) << (exponent - SubBucketBits);
+	}
+
+	static constexpr uint64_t UpperBound(std::size_t index) {
+		return index + 1 < Buckets ? LowerBound(index + 1) - 1 : UINT64_MAX;
+	}
+
+private:
+	static std::size_t HighestBit(uint64_t value) {
+#ifdef _MSC_VER
+		unsigned long ret = 0;
+		_BitScanReverse64(&ret, value);
+		return ret;
+#else
+		return 63 - static_cast<std::size_t>(__builtin_clzll(value));
+#endif
+	}
+
+	// Threads take shards round robin on their first record
+	static std::size_t ShardIndex() {
+		static std::atomic<std::size_t> next = 0;
+		thread_local const auto index = next.fetch_add(1, std::memory_order_relaxed) % Shards;
+		return index;
+	}
+
+	struct alignas(64) Shard {
+		std::array<std::atomic<uint64_t>, Buckets> counts {};
+		std::atomic<uint64_t> sum = 0;
+	};
+
+	std::array<Shard, Shards> shards {};
+};
+}
\ No newline at end of file
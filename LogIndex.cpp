@@ -0,0 +1,149 @@
+#include "LogIndex.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+namespace Fetcko {
+namespace {
+// The string value after "key":" in one of our own JSON lines
+std::string_view JsonString(std::string_view line, std::string_view key) {
+	const auto at = line.find(key);
+	if (at == std::string_view::npos) return {};
+
+	const auto begin = at + key.size();
+	const auto end = line.find('"', begin);
+	return end == std::string_view::npos ? std::string_view() : line.substr(begin, end - begin);
+}
+
+// "[Warning] (17Oct2026 02:13:13) Class<padding> (name) [0x...]: ..."
+bool ParseText(std::string_view line, LogIndex::LineInfo &info) {
+	const auto close = line.find("] (");
+	if (line.empty() || line[0] != '[' || close == std::string_view::npos) return false;
+
+	auto label = line.substr(1, close - 1);
+	while (!label.empty() && label.front() == ' ') label.remove_prefix(1);
+	while (!label.empty() && label.back() == ' ') label.remove_suffix(1);
+
+	if (!Logger::ParseLevel(label, info.level)) return false;
+
+	line.remove_prefix(close + 3);
+	const auto length = Timestamp::Parse(line, info.nanoseconds);
+	if (!length || line.compare(length, 2, ") ") != 0) return false;
+
+	line.remove_prefix(length + 2);
+	info.className = line.substr(0, line.find(' '));
+
+	return true;
+}
+
+// {"ts":...,"level":"...","class":"...",...}
+bool ParseJson(std::string_view line, LogIndex::LineInfo &info) {
+	constexpr std::string_view Ts = "{\"ts\":";
+	if (line.compare(0, Ts.size(), Ts) != 0) return false;
+
+	const std::string number(line.substr(Ts.size(), 20));
+	char *end = nullptr;
+	info.nanoseconds = std::strtoll(number.c_str(), &end, 10);
+	if (end == number.c_str()) return false;
+
+	info.className = JsonString(line, "\"class\":\"");
+	return Logger::ParseLevel(JsonString(line, "\"level\":\""), info.level);
+}
+}
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+std::filesystem::path LogIndex::IndexPath(const std::filesystem::path &log) {
+	auto ret = log;
+	ret += ".idx";
+	return ret;
+}
+
+bool LogIndex::ParseLine(std::string_view line, LineInfo &info) {
+	return !line.empty() && (line[0] == '{' ? ParseJson(line, info) : ParseText(line, info));
+}
+
+LogIndex::Reader::Reader(std::filesystem::path log) : log(std::move(log)) {
+	std::ifstream in(IndexPath(this->log), std::ios::in | std::ios::binary);
+
+	std::array<char, Magic.size()> magic {};
+	uint8_t version = 0;
+
+	in.read(magic.data(), magic.size());
+	in.read(reinterpret_cast<char *>(&version), sizeof(version));
+
+	if (!in || magic != Magic || version != Version) return;
+
+	std::error_code error;
+	const auto logSize = std::filesystem::file_size(this->log, error);
+	if (error) return;
+
+	// Entries past the end of the log, or out of order, would
+	// be from a crash between writing the two; stop at them
+	Entry entry;
+	while (in.read(reinterpret_cast<char *>(&entry), sizeof(entry))) {
+		if (entry.begin > entry.end || entry.end > logSize || (!entries.empty() && entry.begin < entries.back().end))
+			break;
+
+		entries.push_back(entry);
+	}
+
+	latestSoFar.resize(entries.size());
+	earliestFrom.resize(entries.size());
+
+	for (std::size_t i = 0; i < entries.size(); ++i)
+		latestSoFar[i] = std::max(entries[i].latest, i ? latestSoFar[i - 1] : entries[i].latest);
+
+	for (std::size_t i = entries.size(); i-- > 0;)
+		earliestFrom[i] = std::min(entries[i].earliest, i + 1 < entries.size() ? earliestFrom[i + 1] : entries[i].earliest);
+}
+
+std::size_t LogIndex::Reader::Run(const Query &query, const std::function<void(std::string_view)> &f) const {
+	std::ifstream in(log, std::ios::in | std::ios::binary);
+	if (!in) return 0;
+
+	std::size_t count = 0;
+	bool matching = false;
+	std::string line;
+
+	const auto scan = [&](uint64_t begin, uint64_t end) {
+		in.clear();
+		in.seekg(static_cast<std::streamoff>(begin));
+
+		matching = false;
+		for (auto position = begin; position < end && std::getline(in, line); position += line.size() + 1) {
+			if (LineInfo info; ParseLine(line, info)) {
+				matching =
+					info.nanoseconds >= query.from &&
+					info.nanoseconds <= query.to &&
+					info.level >= query.level &&
+					(query.className.empty() || info.className == query.className);
+			}
+
+			if (matching) {
+				f(line);
+				++count;
+			}
+		}
+	};
+
+	// The first chunk with anything at or after from, through
+	// the last with anything at or before to
+	const auto first = static_cast<std::size_t>(
+		std::lower_bound(latestSoFar.begin(), latestSoFar.end(), query.from) - latestSoFar.begin()
+	);
+	const auto last = static_cast<std::size_t>(
+		std::upper_bound(earliestFrom.begin(), earliestFrom.end(), query.to) - earliestFrom.begin()
+	);
+
+	if (first < last)
+		scan(entries[first].begin, entries[last - 1].end);
+
+	// Whatever was written after the last full chunk isn't indexed yet
+	scan(entries.empty() ? 0 : entries.back().end, std::numeric_limits<uint64_t>::max());
+
+	return count;
+}
+}
\ No newline at end of file
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Logger.hpp"
+
+namespace Fetcko {
+// A sparse index beside a log file, written by IndexedFileSink, so
+// that a time range can be found without reading the whole log. The
+// log is cut into chunks of lines, and each chunk gets one entry.
+//
+// Layout of <log>.idx (integers little-endian as written by the host):
+//	char[4]	Magic
+//	uint8	Version
+// then one Entry per chunk, in file order.
+//
+// Lines may come slightly out of time order (they're stamped when
+// logged, not when written), so an entry keeps both the earliest
+// and latest time in its chunk rather than assuming either end.
+class LogIndex {
+public:
+	static constexpr std::array<char, 4> Magic = { 'F', 'L', 'I', 'X' };
+	static constexpr uint8_t Version = 1;
+
+	struct Entry {
+		// Byte range of the chunk in the log
+		uint64_t begin = 0;
+		uint64_t end = 0;
+
+		// Nanoseconds since the system_clock epoch
+		int64_t earliest = 0;
+		int64_t latest = 0;
+	};
+
+	// logs/app.log's is logs/app.log.idx
+	static std::filesystem::path IndexPath(const std::filesystem::path &log);
+
+	// What a log line's header says, text or JSON
+	struct LineInfo {
+		int64_t nanoseconds = 0;
+		Logger::Level level = Logger::Level::Info;
+		std::string_view className;
+	};
+
+	// False for anything that doesn't start with a header, like
+	// the rest of a message that had newlines in it
+	static bool ParseLine(std::string_view line, LineInfo &info);
+
+	struct Query {
+		// Both inclusive
+		int64_t from = std::numeric_limits<int64_t>::min();
+		int64_t to = std::numeric_limits<int64_t>::max();
+
+		Logger::Level level = Logger::Level::Info;
+
+		// As it's written in the log; empty matches any
+		std::string className;
+	};
+
+	class Reader {
+	public:
+		// Reads the whole index; the log is read as queries need it
+		explicit Reader(std::filesystem::path log);
+
+		// Whether the index was there. Without it every
+		// query still works, by reading the whole log.
+		bool HasIndex() const { return !entries.empty(); }
+		const std::vector<Entry> &GetEntries() const { return entries; }
+
+		// Calls f with every line matching query, in file order.
+		// Lines without a header of their own go with the one
+		// before them. Returns how many lines matched.
+		std::size_t Run(const Query &query, const std::function<void(std::string_view)> &f) const;
+
+	private:
+		std::filesystem::path log;
+		std::vector<Entry> entries;
+
+		// Latest time in any chunk up to each entry, and earliest in
+		// any from it on; unlike the entries themselves, both sorted
+		std::vector<int64_t> latestSoFar;
+		std::vector<int64_t> earliestFrom;
+	};
+};
+}
\ No newline at end of file
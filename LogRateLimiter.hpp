@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "Logger.hpp"
+#include "Timestamp.hpp"
+
+// Rate limited and sampled logging. Each expansion declares its own
+// static LogRateLimiter, so a call site is identified at compile time
+// and deciding whether to log is a couple of relaxed atomics on state
+// only that call site touches. Nothing is formatted or evaluated when
+// a message is suppressed.
+//
+// level is a Logger::Level name (Info, Debug, Warning, Error).
+// The plain forms log through *this, the _TO forms through target:
+//	FETCKO_LOG_PER_SECOND(10, Warning, "Retrying ", path);
+//	FETCKO_LOG_EVERY_N_TO(connection, 1000, Debug, "Read ", bytes, " bytes");
+//	FETCKO_LOG_FIRST_N(5, Error, "Bad packet from ", address);
+//
+// PerSecond's "suppressed N similar messages" line goes out with the
+// next message that site is allowed to log. A burst that stops for
+// good is summarized by Logger::FlushRepeats (at exit, say) or the
+// console timer once its second is over, under the header of the
+// object it was last held back from, copied when the burst began.
+#define FETCKO_LOG_LIMITED(target, mode, n, level, ...) \
+	do { \
+		if constexpr (::Fetcko::Logger::IsCompiledIn(::Fetcko::Logger::Level::level)) { \
+			static ::Fetcko::LogRateLimiter fetckoLimiter(::Fetcko::LogRateLimiter::Mode::mode, n, __FILE__, __LINE__); \
+			if ((target).IsLevelEnabled(::Fetcko::Logger::Level::level)) { \
+				if (const auto fetckoDecision = fetckoLimiter.Allow(); fetckoDecision.allowed) { \
+					if (fetckoDecision.suppressed) \
+						(target).Log(::Fetcko::Logger::Level::level, fetckoLimiter.Summary(fetckoDecision.suppressed)); \
+					(target).Log(::Fetcko::Logger::Level::level, __VA_ARGS__); \
+					if (fetckoDecision.silencing) \
+						(target).Log(::Fetcko::Logger::Level::level, fetckoLimiter.Summary(0)); \
+				} else if (fetckoDecision.holding) { \
+					(target).HoldSuppressed(fetckoLimiter, ::Fetcko::Logger::Level::level); \
+				} \
+			} \
+		} \
+	} while (false)
+
+#define FETCKO_LOG_PER_SECOND_TO(target, n, level, ...) FETCKO_LOG_LIMITED(target, PerSecond, n, level, __VA_ARGS__)
+#define FETCKO_LOG_EVERY_N_TO(target, n, level, ...) FETCKO_LOG_LIMITED(target, EveryNth, n, level, __VA_ARGS__)
+#define FETCKO_LOG_FIRST_N_TO(target, n, level, ...) FETCKO_LOG_LIMITED(target, FirstN, n, level, __VA_ARGS__)
+
+#define FETCKO_LOG_PER_SECOND(n, level, ...) FETCKO_LOG_PER_SECOND_TO(*this, n, level, __VA_ARGS__)
+#define FETCKO_LOG_EVERY_N(n, level, ...) FETCKO_LOG_EVERY_N_TO(*this, n, level, __VA_ARGS__)
+#define FETCKO_LOG_FIRST_N(n, level, ...) FETCKO_LOG_FIRST_N_TO(*this, n, level, __VA_ARGS__)
+
+namespace Fetcko {
+class LogRateLimiter {
+public:
+	enum class Mode : uint8_t {
+		PerSecond,	// At most n messages per wall-clock second
+		EveryNth,	// The 1st, (n + 1)th, (2n + 1)th...
+		FirstN		// The first n, then nothing
+	};
+
+	struct Decision {
+		bool allowed = false;
+
+		// PerSecond: how many were dropped in earlier windows
+		// and haven't been reported yet
+		uint64_t suppressed = 0;
+
+		// FirstN: this is the last message we'll let through
+		bool silencing = false;
+
+		// PerSecond: the first one dropped since the last summary,
+		// so the target should be told where a summary would go
+		bool holding = false;
+	};
+
+	// constexpr so function-local statics are constant
+	// initialized and don't need a guard check per call
+	constexpr LogRateLimiter(Mode mode, uint64_t n, const char *file, int line) :
+		mode(mode), n(n ? n : 1), file(file), line(line) {}
+
+	Decision Allow() {
+		switch (mode) {
+			case Mode::EveryNth:
+				return { count.fetch_add(1, std::memory_order_relaxed) % n == 0 };
+
+			case Mode::FirstN: {
+				// Once we're past n, stop writing to the counter
+				// so a silenced site doesn't bounce a cache line
+				if (count.load(std::memory_order_relaxed) >= n) return {};
+
+				const auto c = count.fetch_add(1, std::memory_order_relaxed);
+				return { c < n, 0, c + 1 == n };
+			}
+
+			case Mode::PerSecond:
+			default: {
+				// Cheapest with Timestamp::Source::CoarseMonotonic
+				const auto second = Timestamp::Now() / 1000000000;
+
+				if (auto current = window.load(std::memory_order_relaxed); current != second &&
+					window.compare_exchange_strong(current, second, std::memory_order_relaxed))
+					count.store(0, std::memory_order_relaxed);
+
+				if (count.fetch_add(1, std::memory_order_relaxed) >= n)
+					return { false, 0, false, suppressed.fetch_add(1, std::memory_order_relaxed) == 0 };
+
+				return { true, suppressed.load(std::memory_order_relaxed) ? suppressed.exchange(0, std::memory_order_relaxed) : 0 };
+			}
+		}
+	}
+
+	// "suppressed 12,345 similar messages from Foo.cpp:42", or
+	// for a silenced FirstN site (count of 0), a note saying so
+	std::string Summary(uint64_t count) const {
+		const auto location = std::string(GetFile()) + ":" + std::to_string(line);
+
+		if (!count)
+			return "further messages from " + location + " will be suppressed";
+
+		auto digits = std::to_string(count);
+		for (auto i = static_cast<std::ptrdiff_t>(digits.size()) - 3; i > 0; i -= 3)
+			digits.insert(static_cast<std::size_t>(i), 1, ',');
+
+		return "suppressed " + digits + " similar message" + (count == 1 ? "" : "s") + " from " + location;
+	}
+
+	// Just the file name; __FILE__ is often a full path
+	std::string_view GetFile() const {
+		const std::string_view path(file);
+
+		if (const auto slash = path.find_last_of("/\\"); slash != std::string_view::npos)
+			return path.substr(slash + 1);
+
+		return path;
+	}
+
+	int GetLine() const { return line; }
+
+	// The second (of Timestamp::Now) the current window started in
+	int64_t GetWindow() const { return window.load(std::memory_order_relaxed); }
+
+	// How many have been dropped and not yet reported, now reported
+	uint64_t TakeSuppressed() { return suppressed.exchange(0, std::memory_order_relaxed); }
+
+private:
+	const Mode mode;
+	const uint64_t n;
+
+	const char *file;
+	const int line;
+
+	std::atomic<uint64_t> count = 0;
+	std::atomic<uint64_t> suppressed = 0;
+	std::atomic<int64_t> window = -1;
+};
+}
\ No newline at end of file
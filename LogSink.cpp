@@ -0,0 +1,582 @@
+#include "LogSink.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "CompressedLog.hpp"
+
+#ifndef WIN32
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+namespace Fetcko {
+namespace {
+// What std::cout wrote to when the first ConsoleSink was made,
+// which (that being the default sink) is before main
+std::streambuf *StandardBuffer() {
+	static auto *const ret = std::cout.rdbuf();
+	return ret;
+}
+}
+
+// ===============================================
+// ================ ConsoleSink ==================
+// ===============================================
+ConsoleSink::ConsoleSink(Logger::Format format) : LogSink(format) {
+	StandardBuffer();
+
+#ifndef WIN32
+	colors = isatty(STDOUT_FILENO) && !std::getenv("NO_COLOR");
+#endif
+}
+
+ConsoleSink::ConsoleSink(std::ostream &out, Logger::Format format) : LogSink(format), colors(false), out(&out) {
+	StandardBuffer();
+}
+
+bool ConsoleSink::IsStandardOutput() const {
+	return !out && std::cout.rdbuf() == StandardBuffer();
+}
+
+ConsoleSink::~ConsoleSink() {
+	WritePending();
+}
+
+void ConsoleSink::Write(Logger::Level level, std::string_view text) {
+	const auto index = static_cast<std::size_t>(level);
+
+#ifdef WIN32
+	if (colors && IsStandardOutput() && static_cast<int>(level) != pendingLevel) {
+		WritePending();
+
+		SetConsoleTextAttribute(Logger::out, static_cast<WORD>(Logger::Colors[index]));
+		pendingLevel = static_cast<int>(level);
+	}
+
+	// The \r puts us back over the prompt, if there is one
+	pending += '\r';
+	pending.append(text);
+#else
+	pending += '\r';
+
+	if (colors && IsStandardOutput()) {
+		pending.append(Logger::Colors[index]);
+		pending.append(text);
+		pending.append(Logger::DefaultColor);
+	} else {
+		pending.append(text);
+	}
+#endif
+
+	pending += '\n';
+}
+
+void ConsoleSink::Flush() {
+#ifdef WIN32
+	WritePending();
+
+	if (!out)
+		Logger::PrintPrompt();
+
+	// PrintPrompt put the console back to the default color
+	pendingLevel = -1;
+#else
+	// Nothing to redraw the prompt after; the console
+	// thread's timer flushes even when nothing's been written
+	if (pending.empty()) return;
+
+	if (!out && Logger::hasCommands.load(std::memory_order_relaxed))
+		pending.append(Logger::Prompt);
+
+	WritePending();
+#endif
+}
+
+void ConsoleSink::WritePending() {
+	if (pending.empty()) return;
+
+	// Anything else written through std::cout (command
+	// replies, say) has to come out before this does
+	std::cout.flush();
+
+#ifdef WIN32
+	auto &stream = out ? *out : std::cout;
+	stream.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+	stream.flush();
+#else
+	if (!IsStandardOutput()) {
+		auto &stream = out ? *out : std::cout;
+		stream.write(pending.data(), static_cast<std::streamsize>(pending.size()));
+		stream.flush();
+
+		pending.clear();
+		return;
+	}
+
+	const auto *data = pending.data();
+	auto left = pending.size();
+
+	while (left) {
+		const auto written = write(STDOUT_FILENO, data, left);
+
+		if (written < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+
+		data += written;
+		left -= static_cast<std::size_t>(written);
+	}
+#endif
+
+	pending.clear();
+}
+
+// ===============================================
+// =============== MappedFileSink ================
+// ===============================================
+MappedFileSink::MappedFileSink(Options &&options) : LogSink(options.format), options(std::move(options)) {
+	if (!this->options.segmentSize) {
+		std::cerr << "MappedFileSink: segmentSize can't be zero for " << this->options.path.u8string() << std::endl;
+		return;
+	}
+
+	// Carry on after any segments left by a previous run
+	// rather than overwriting them
+	for (const auto index : FindSegments())
+		current.index = std::max(current.index, index + 1);
+
+	Prune(current.index);
+	if (!OpenSegment(current)) return;
+
+	segmentOpened = std::chrono::steady_clock::now();
+
+	preparer = std::thread([this] { PrepareLoop(); });
+}
+
+MappedFileSink::~MappedFileSink() {
+	{
+		std::unique_lock lock(prepareMutex);
+		stopping = true;
+	}
+	prepareWake.notify_one();
+
+	if (preparer.joinable())
+		preparer.join();
+
+	// Whatever the preparer hadn't got round to
+	for (auto &segment : retired)
+		CloseSegment(segment);
+
+	CloseSegment(current);
+	Prune(current.index);
+
+	// Made but never written to, so it would only be an empty file
+	if (nextReady && next.data) {
+		CloseSegment(next);
+
+		std::error_code error;
+		std::filesystem::remove(next.path, error);
+	}
+}
+
+void MappedFileSink::Write(Logger::Level, std::string_view text) {
+	if (!current.data) return;
+
+	// A line longer than a whole segment gets cut short
+	const auto size = std::min(text.size(), options.segmentSize - 1);
+
+	if (current.used + size + 1 > options.segmentSize) {
+		Rotate();
+		if (!current.data) return;
+	}
+
+	std::memcpy(current.data + current.used, text.data(), size);
+	current.used += size;
+	current.data[current.used++] = '\n';
+}
+
+void MappedFileSink::Flush() {
+	if (options.rotateAfter.count() && current.used &&
+		std::chrono::steady_clock::now() - segmentOpened >= options.rotateAfter)
+		Rotate();
+}
+
+void MappedFileSink::Rotate() {
+	{
+		std::unique_lock lock(prepareMutex);
+
+		// Only waits if a whole segment filled up
+		// faster than the next one could be made
+		prepared.wait(lock, [this] { return nextReady; });
+
+		retired.push_back(std::move(current));
+		current = std::move(next);
+		next = {};
+		nextReady = false;
+	}
+	prepareWake.notify_one();
+
+	segmentOpened = std::chrono::steady_clock::now();
+}
+
+void MappedFileSink::PrepareLoop() {
+	std::unique_lock lock(prepareMutex);
+
+	while (true) {
+		prepareWake.wait(lock, [this] { return stopping || !nextReady || !retired.empty(); });
+		if (stopping) break;
+
+		auto closing = std::move(retired);
+		retired.clear();
+
+		const auto making = !nextReady;
+		const auto index = current.index + 1;
+
+		lock.unlock();
+
+		for (auto &segment : closing)
+			CloseSegment(segment);
+
+		Segment segment;
+		if (making) {
+			Prune(index - 1);
+
+			segment.index = index;
+			OpenSegment(segment);
+		}
+
+		lock.lock();
+
+		if (making) {
+			next = std::move(segment);
+			nextReady = true;
+			prepared.notify_one();
+		}
+	}
+}
+
+void MappedFileSink::Prune(std::size_t newest) const {
+	if (!options.maxSegments) return;
+
+	// Everything too old, not just the one that just fell off the
+	// end, so a lower maxSegments than last time catches up at once
+	for (const auto index : FindSegments()) {
+		if (index + options.maxSegments <= newest) {
+			std::error_code error;
+			std::filesystem::remove(SegmentPath(index), error);
+		}
+	}
+}
+
+std::filesystem::path MappedFileSink::SegmentPath(std::size_t index) const {
+	auto ret = options.path;
+	ret.replace_filename(
+		options.path.stem().u8string() + "." + std::to_string(index) + options.path.extension().u8string()
+	);
+	return ret;
+}
+
+std::vector<std::size_t> MappedFileSink::FindSegments() const {
+	std::vector<std::size_t> ret;
+
+	const auto directory = options.path.parent_path();
+	const auto prefix = options.path.stem().u8string() + ".";
+	const auto extension = options.path.extension().u8string();
+
+	std::error_code error;
+	for (const auto &entry : std::filesystem::directory_iterator(directory.empty() ? "." : directory, error)) {
+		const auto name = entry.path().filename().u8string();
+
+		if (name.size() <= prefix.size() + extension.size() ||
+			name.compare(0, prefix.size(), prefix) != 0 ||
+			name.compare(name.size() - extension.size(), extension.size(), extension) != 0)
+			continue;
+
+		const auto index = name.substr(prefix.size(), name.size() - prefix.size() - extension.size());
+		if (!index.empty() && std::all_of(index.begin(), index.end(), [](char c) { return c >= '0' && c <= '9'; }))
+			ret.push_back(std::stoull(index));
+	}
+
+	return ret;
+}
+
+bool MappedFileSink::OpenSegment(Segment &segment) const {
+	segment.path = SegmentPath(segment.index);
+	segment.used = 0;
+
+#ifdef WIN32
+	segment.file = CreateFileW(
+		segment.path.c_str(),
+		GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ,
+		nullptr,
+		CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL,
+		nullptr
+	);
+
+	if (segment.file == INVALID_HANDLE_VALUE) {
+		std::cerr << "MappedFileSink: couldn't create " << segment.path.u8string() << std::endl;
+		return false;
+	}
+
+	// Mapping past the end of the file grows it to size
+	const auto size = static_cast<uint64_t>(options.segmentSize);
+	segment.mapping = CreateFileMappingW(segment.file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+
+	if (segment.mapping)
+		segment.data = static_cast<char *>(MapViewOfFile(segment.mapping, FILE_MAP_WRITE, 0, 0, options.segmentSize));
+#else
+	segment.file = open(segment.path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (segment.file == -1) {
+		std::cerr << "MappedFileSink: couldn't create " << segment.path.u8string() << std::endl;
+		return false;
+	}
+
+	// Reserve the blocks up front. Writing to a sparse mapping
+	// on a full disk would raise SIGBUS instead of failing here.
+	if (posix_fallocate(segment.file, 0, static_cast<off_t>(options.segmentSize)) == 0) {
+		auto *map = mmap(nullptr, options.segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, segment.file, 0);
+
+		if (map != MAP_FAILED)
+			segment.data = static_cast<char *>(map);
+	}
+#endif
+
+	if (!segment.data) {
+		std::cerr << "MappedFileSink: couldn't map " << segment.path.u8string() << std::endl;
+		CloseSegment(segment);
+		return false;
+	}
+
+	return true;
+}
+
+void MappedFileSink::CloseSegment(Segment &segment) const {
+	// Trim the unused, preallocated tail so readers
+	// don't see a run of zeros at the end of the file
+#ifdef WIN32
+	if (segment.data) UnmapViewOfFile(segment.data);
+	if (segment.mapping) CloseHandle(segment.mapping);
+
+	if (segment.file != INVALID_HANDLE_VALUE) {
+		LARGE_INTEGER size;
+		size.QuadPart = static_cast<LONGLONG>(segment.used);
+
+		SetFilePointerEx(segment.file, size, nullptr, FILE_BEGIN);
+		SetEndOfFile(segment.file);
+		CloseHandle(segment.file);
+	}
+
+	segment.mapping = nullptr;
+	segment.file = INVALID_HANDLE_VALUE;
+#else
+	if (segment.data) munmap(segment.data, options.segmentSize);
+
+	if (segment.file != -1) {
+		if (ftruncate(segment.file, static_cast<off_t>(segment.used)) != 0)
+			std::cerr << "MappedFileSink: couldn't trim " << segment.path.u8string() << std::endl;
+
+		close(segment.file);
+	}
+
+	segment.file = -1;
+#endif
+
+	segment.data = nullptr;
+}
+
+// ===============================================
+// ============= CompressedFileSink ==============
+// ===============================================
+CompressedFileSink::CompressedFileSink(Options &&options) : LogSink(options.format), options(std::move(options)) {
+	file.open(this->options.path, std::ios::out | std::ios::binary | std::ios::app);
+
+	if (!file) {
+		std::cerr << "CompressedFileSink: couldn't open " << this->options.path.u8string() << std::endl;
+		failed = true;
+		return;
+	}
+
+	// Appending to an earlier run's file just adds more blocks
+	std::error_code error;
+	if (!std::filesystem::file_size(this->options.path, error)) {
+		file.write(CompressedLog::Magic.data(), CompressedLog::Magic.size());
+		file.write(reinterpret_cast<const char *>(&CompressedLog::Version), sizeof(CompressedLog::Version));
+	}
+
+	block.reserve(this->options.blockSize + 1024);
+}
+
+CompressedFileSink::~CompressedFileSink() {
+	WriteBlock();
+}
+
+void CompressedFileSink::Write(Logger::Level, std::string_view text) {
+	if (block.empty())
+		blockStarted = std::chrono::steady_clock::now();
+
+	block.append(text);
+	block += '\n';
+
+	if (block.size() >= options.blockSize)
+		WriteBlock();
+}
+
+void CompressedFileSink::Flush() {
+	if (options.flushAfter.count() && !block.empty() &&
+		std::chrono::steady_clock::now() - blockStarted >= options.flushAfter)
+		WriteBlock();
+}
+
+void CompressedFileSink::WriteBlock() {
+	if (block.empty()) return;
+
+	// Lines that have nowhere to go are thrown away,
+	// rather than piling up until the disk has room
+	if (!file) {
+		if (!failed)
+			std::cerr << "CompressedFileSink: couldn't write to " << options.path.u8string() << std::endl;
+
+		failed = true;
+		block.clear();
+		return;
+	}
+
+	encoded.clear();
+	CompressedLog::EncodeBlock(block.data(), block.size(), encoded, scratch);
+
+	// Flushed a block at a time, so a crash
+	// never leaves more than one of them torn
+	file.write(encoded.data(), static_cast<std::streamsize>(encoded.size()));
+	file.flush();
+
+	bytesIn += block.size();
+	bytesOut += encoded.size();
+
+	block.clear();
+}
+
+// ===============================================
+// =============== IndexedFileSink ===============
+// ===============================================
+IndexedFileSink::IndexedFileSink(Options &&options) : LogSink(options.format), options(std::move(options)) {
+	const auto indexPath = LogIndex::IndexPath(this->options.path);
+
+	// Appending to an earlier run's log carries on its index too
+	std::error_code error;
+	offset = std::filesystem::file_size(this->options.path, error);
+	if (error) offset = 0;
+
+	// Only the entries the Reader trusts are kept. Anything after them
+	// is from a crash, and would hide whatever we append from it.
+	const LogIndex::Reader reader(this->options.path);
+	const auto &entries = reader.GetEntries();
+	const auto indexed = entries.empty() ? 0 : entries.back().end;
+
+	if (!entries.empty()) {
+		std::filesystem::resize_file(
+			indexPath,
+			LogIndex::Magic.size() + sizeof(LogIndex::Version) + entries.size() * sizeof(LogIndex::Entry),
+			error
+		);
+	}
+
+	file.open(this->options.path, std::ios::out | std::ios::binary | std::ios::app);
+	index.open(indexPath, std::ios::out | std::ios::binary | (entries.empty() ? std::ios::trunc : std::ios::app));
+
+	if (!file || !index) {
+		std::cerr << "IndexedFileSink: couldn't open " << this->options.path.u8string() << std::endl;
+		file.close();
+		return;
+	}
+
+	if (entries.empty()) {
+		index.write(LogIndex::Magic.data(), LogIndex::Magic.size());
+		index.write(reinterpret_cast<const char *>(&LogIndex::Version), sizeof(LogIndex::Version));
+	}
+
+	chunk.begin = chunk.end = offset;
+
+	// A run that crashed may have written lines its index never got to
+	if (offset > indexed)
+		IndexTail(indexed);
+}
+
+IndexedFileSink::~IndexedFileSink() {
+	CloseChunk();
+}
+
+void IndexedFileSink::Write(Logger::Level level, std::string_view text) {
+	WriteTimed(level, Timestamp::Now(), text);
+}
+
+void IndexedFileSink::WriteTimed(Logger::Level, int64_t nanoseconds, std::string_view text) {
+	if (!file.is_open()) return;
+
+	file.write(text.data(), static_cast<std::streamsize>(text.size()));
+	file.put('\n');
+	offset += text.size() + 1;
+
+	Track(nanoseconds);
+	if (IsChunkFull()) CloseChunk();
+}
+
+void IndexedFileSink::Flush() {
+	file.flush();
+}
+
+void IndexedFileSink::Track(int64_t nanoseconds) {
+	if (!chunkRecords++) {
+		chunk.earliest = chunk.latest = nanoseconds;
+	} else {
+		chunk.earliest = std::min(chunk.earliest, nanoseconds);
+		chunk.latest = std::max(chunk.latest, nanoseconds);
+	}
+}
+
+void IndexedFileSink::CloseChunk() {
+	if (!chunkRecords || !file.is_open()) return;
+
+	// The lines have to be on disk before the entry pointing at them
+	file.flush();
+
+	chunk.end = offset;
+	index.write(reinterpret_cast<const char *>(&chunk), sizeof(chunk));
+	index.flush();
+
+	chunk.begin = offset;
+	chunkRecords = 0;
+}
+
+void IndexedFileSink::IndexTail(uint64_t from) {
+	const auto end = offset;
+
+	std::ifstream in(options.path, std::ios::in | std::ios::binary);
+	in.seekg(static_cast<std::streamoff>(from));
+
+	chunk.begin = chunk.end = offset = from;
+
+	// Chunks only end before a header, so lines without one of
+	// their own stay in the same chunk as the message they're from
+	std::string line;
+	while (offset < end && std::getline(in, line)) {
+		if (LogIndex::LineInfo info; LogIndex::ParseLine(line, info)) {
+			if (IsChunkFull()) CloseChunk();
+			Track(info.nanoseconds);
+		}
+
+		offset = std::min<uint64_t>(offset + line.size() + 1, end);
+	}
+
+	offset = end;
+}
+}
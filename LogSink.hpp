@@ -0,0 +1,274 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Logger.hpp"
+#include "LogIndex.hpp"
+
+namespace Fetcko {
+// Somewhere finished log lines go. Logger calls Write and Flush
+// with its mutex held (or from its single writer thread), so
+// sinks don't need any locking of their own.
+class LogSink {
+public:
+	explicit LogSink(Logger::Format format = Logger::Format::Text) : format(format) {}
+	virtual ~LogSink() = default;
+
+	// text is one message without its trailing newline
+	virtual void Write(Logger::Level level, std::string_view text) = 0;
+
+	// What Logger actually calls, with when the message was logged
+	// (nanoseconds since the system_clock epoch). Only sinks that
+	// care about the time need to override it.
+	virtual void WriteTimed(Logger::Level level, int64_t nanoseconds, std::string_view text) {
+		(void)nanoseconds;
+		Write(level, text);
+	}
+
+	// Called once after each batch of writes
+	virtual void Flush() {}
+
+	// Messages have to pass both Logger::logLevel and this
+	void SetLevel(Logger::Level level) { this->level = level; }
+	Logger::Level GetLevel() const { return level; }
+	bool Accepts(Logger::Level level) const { return level >= this->level; }
+
+	// Fixed for the sink's lifetime, since
+	// Logger only checks it in AddSink
+	Logger::Format GetFormat() const { return format; }
+
+private:
+	Logger::Level level = Logger::Level::Info;
+	const Logger::Format format;
+};
+
+// The default sink: standard output, with level colors and the
+// " > " prompt redrawn after each batch. Lines are gathered until
+// Flush, then the batch and the prompt go out in a single write.
+//
+// If std::cout has been pointed somewhere else (with rdbuf, to
+// capture the log, say), batches go through it instead, uncolored.
+class ConsoleSink : public LogSink {
+public:
+	// Colors are on if standard output is a terminal
+	// (and NO_COLOR isn't set); always on Windows.
+	explicit ConsoleSink(Logger::Format format = Logger::Format::Text);
+
+	// Writes batches to out instead, without colors
+	explicit ConsoleSink(std::ostream &out, Logger::Format format = Logger::Format::Text);
+
+	~ConsoleSink() override;
+
+	void Write(Logger::Level level, std::string_view text) override;
+	void Flush() override;
+
+	void SetColors(bool colors) { this->colors = colors; }
+	bool HasColors() const { return colors; }
+
+private:
+	// Everything since the last Flush
+	std::string pending;
+
+	bool colors = true;
+
+	// Null for standard output
+	std::ostream *out = nullptr;
+
+	// Whether pending goes straight to standard output, rather than
+	// through a stream; only then are the colors written
+	bool IsStandardOutput() const;
+
+#ifdef WIN32
+	// Colors are console state there rather than part of the text,
+	// so pending is written out whenever the level changes.
+	// -1 is the console's default color.
+	int pendingLevel = -1;
+#endif
+
+	void WritePending();
+};
+
+// Writes into a memory-mapped, preallocated segment file and
+// moves on to a new one when it fills up or gets too old.
+// Writing a line is a memcpy; the OS pages it out on its own.
+// The next segment is created and mapped ahead of time, and full
+// ones are trimmed and closed afterwards, by a thread of the sink's
+// own, so rotating is just a swap wherever Write is called.
+//
+// For a path of logs/app.log, segments are named
+// logs/app.0.log, logs/app.1.log and so on.
+class MappedFileSink : public LogSink {
+public:
+	struct Options {
+		std::filesystem::path path;
+		// Must be more than zero, or nothing is written
+		std::size_t segmentSize = 64 * 1024 * 1024;
+
+		// Zero means only rotate by size
+		std::chrono::seconds rotateAfter { 0 };
+
+		// Oldest segments past this many are deleted, including
+		// ones left by earlier runs. Zero keeps all of them.
+		std::size_t maxSegments = 0;
+
+		Logger::Format format = Logger::Format::Text;
+	};
+
+	explicit MappedFileSink(Options &&options);
+	virtual ~MappedFileSink();
+
+	void Write(Logger::Level level, std::string_view text) override;
+	void Flush() override;
+
+	const std::filesystem::path &GetSegmentPath() const { return current.path; }
+
+	// The indices of every segment on disk, this run's or not,
+	// in no particular order
+	std::vector<std::size_t> FindSegments() const;
+	std::filesystem::path SegmentPath(std::size_t index) const;
+
+private:
+	struct Segment {
+		std::filesystem::path path;
+		std::size_t index = 0;
+
+		char *data = nullptr;
+		std::size_t used = 0;
+
+#ifdef WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+#else
+		int file = -1;
+#endif
+	};
+
+	bool OpenSegment(Segment &segment) const;
+	void CloseSegment(Segment &segment) const;
+	void Rotate();
+
+	// Deletes everything too old to keep alongside newest
+	void Prune(std::size_t newest) const;
+
+	void PrepareLoop();
+
+	Options options;
+
+	// Only touched by Write, Flush and Rotate
+	Segment current;
+	std::chrono::steady_clock::time_point segmentOpened;
+
+	// All guarded by prepareMutex
+	std::mutex prepareMutex;
+	std::condition_variable prepareWake;
+	std::condition_variable prepared;
+	Segment next;
+	bool nextReady = false;
+	std::vector<Segment> retired;
+	bool stopping = false;
+
+	std::thread preparer;
+};
+
+// Appends to a CompressedLog file, one block each time blockSize
+// bytes of text have built up. Compression happens wherever Write
+// is called, so with Logger::StartAsync, on the writer thread and
+// never on the producers. Read it back with CompressedLog::Reader.
+class CompressedFileSink : public LogSink {
+public:
+	struct Options {
+		std::filesystem::path path;
+
+		// Bigger blocks compress better, but a crash
+		// loses whatever hasn't made it into one yet
+		std::size_t blockSize = 256 * 1024;
+
+		// A partial block is written out once it's this old.
+		// Zero means only when it's full.
+		std::chrono::seconds flushAfter { 5 };
+
+		Logger::Format format = Logger::Format::Text;
+	};
+
+	explicit CompressedFileSink(Options &&options);
+	virtual ~CompressedFileSink();
+
+	void Write(Logger::Level level, std::string_view text) override;
+	void Flush() override;
+
+	// Text in and bytes out so far, for working out the ratio
+	uint64_t GetBytesIn() const { return bytesIn; }
+	uint64_t GetBytesOut() const { return bytesOut; }
+
+private:
+	void WriteBlock();
+
+	Options options;
+	std::ofstream file;
+
+	// So a file that can't be written is only complained about once
+	bool failed = false;
+
+	std::string block;
+	std::chrono::steady_clock::time_point blockStarted;
+
+	// Reused for every block
+	std::string encoded;
+	std::string scratch;
+
+	uint64_t bytesIn = 0;
+	uint64_t bytesOut = 0;
+};
+
+// Appends plain lines to a file, with a LogIndex beside it (the
+// same path plus .idx) so LogIndex::Reader can answer "everything
+// from 14:02 to 14:05" by reading only those chunks. An index entry
+// is written after every indexEvery records or indexBytes bytes,
+// whichever comes first.
+class IndexedFileSink : public LogSink {
+public:
+	struct Options {
+		std::filesystem::path path;
+
+		std::size_t indexEvery = 1024;
+		std::size_t indexBytes = 256 * 1024;
+
+		Logger::Format format = Logger::Format::Text;
+	};
+
+	explicit IndexedFileSink(Options &&options);
+	virtual ~IndexedFileSink();
+
+	void Write(Logger::Level level, std::string_view text) override;
+	void WriteTimed(Logger::Level level, int64_t nanoseconds, std::string_view text) override;
+	void Flush() override;
+
+private:
+	void Track(int64_t nanoseconds);
+	bool IsChunkFull() const { return chunkRecords >= options.indexEvery || offset - chunk.begin >= options.indexBytes; }
+	void CloseChunk();
+	void IndexTail(uint64_t from);
+
+	Options options;
+
+	std::ofstream file;
+	std::ofstream index;
+
+	// Where the next line goes
+	uint64_t offset = 0;
+
+	// The chunk being written; begin == offset while it's empty
+	LogIndex::Entry chunk;
+	std::size_t chunkRecords = 0;
+};
+}
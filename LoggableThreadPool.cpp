@@ -0,0 +1,164 @@
+#include "LoggableThreadPool.hpp"
+
+namespace Fetcko {
+// ===============================================
+// =========== Initializing Statics ==============
+// ===============================================
+thread_local LoggableThreadPool *LoggableThreadPool::currentPool = nullptr;
+thread_local std::size_t LoggableThreadPool::currentWorker = 0;
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+LoggableThreadPool::LoggableThreadPool(std::string &&name, std::size_t threads) :
+	LoggableClass(std::move(name)) {
+	if (!threads)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+
+	Start(std::vector<ThreadPlacement>(threads));
+}
+
+LoggableThreadPool::LoggableThreadPool(std::string &&name, const std::vector<ThreadPlacement> &placements) :
+	LoggableClass(std::move(name)) {
+	Start(placements.empty() ? std::vector<ThreadPlacement>(1) : placements);
+}
+
+LoggableThreadPool::~LoggableThreadPool() {
+	{
+		std::unique_lock lock(wakeMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+
+	for (auto &worker : workers)
+		worker->thread->join();
+}
+
+void LoggableThreadPool::Start(const std::vector<ThreadPlacement> &placements) {
+	const auto threads = placements.size();
+
+	workers.reserve(threads);
+	for (std::size_t i = 0; i < threads; ++i)
+		workers.push_back(std::make_unique<Worker>());
+
+	for (std::size_t i = 0; i < threads; ++i) {
+		workers[i]->thread = std::make_unique<LoggableThread>(
+			GetName() + " #" + std::to_string(i),
+			placements[i],
+			[this, i] { WorkerLoop(i); }
+		);
+	}
+
+	// The workers wait for this, so that they don't go
+	// looking at each other's deques (or their own name)
+	// before they're all there
+	{
+		std::unique_lock lock(wakeMutex);
+		started = true;
+	}
+	wake.notify_all();
+
+	LogInfo("Started ", threads, " workers");
+}
+
+void LoggableThreadPool::Push(Task &&task) {
+	auto &worker = currentPool == this ?
+		*workers[currentWorker] :
+		*workers[nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+
+	// Counted before it's published, or a thief could take it and
+	// decrement pending first, wrapping it around. A worker that sees
+	// the count before the task just goes round once more.
+	//
+	// A worker bumps sleeping before it checks pending, and we bump
+	// pending before we check sleeping, so one of us sees the other
+	pending.fetch_add(1);
+
+	{
+		std::unique_lock lock(worker.mutex);
+		worker.tasks.push_back(std::move(task));
+	}
+
+	if (sleeping.load()) {
+		{ std::unique_lock lock(wakeMutex); }
+		wake.notify_one();
+	}
+}
+
+bool LoggableThreadPool::TryTake(Task &task) {
+	const auto count = workers.size();
+	const auto isWorker = currentPool == this;
+	const auto self = isWorker ? currentWorker : nextWorker.load(std::memory_order_relaxed) % count;
+
+	// Our own newest first
+	if (isWorker) {
+		auto &own = *workers[self];
+		std::unique_lock lock(own.mutex);
+
+		if (!own.tasks.empty()) {
+			task = std::move(own.tasks.back());
+			own.tasks.pop_back();
+			pending.fetch_sub(1);
+			return true;
+		}
+	}
+
+	// Then everyone else's oldest
+	for (std::size_t i = isWorker ? 1 : 0; i < count; ++i) {
+		auto &victim = *workers[(self + i) % count];
+		std::unique_lock lock(victim.mutex);
+
+		if (!victim.tasks.empty()) {
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			pending.fetch_sub(1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+bool LoggableThreadPool::RunPending() {
+	Task task;
+	if (!TryTake(task)) return false;
+
+	task();
+	return true;
+}
+
+void LoggableThreadPool::WorkerLoop(std::size_t index) {
+	{
+		std::unique_lock lock(wakeMutex);
+		wake.wait(lock, [this] { return started; });
+	}
+
+	currentPool = this;
+	currentWorker = index;
+
+	auto &self = *workers[index]->thread;
+	self.LogInfo("Started");
+	Tracer::SetThreadName(self.GetName());
+
+	Task task;
+	while (true) {
+		if (TryTake(task)) {
+			task();
+			task = Task();
+			continue;
+		}
+
+		std::unique_lock lock(wakeMutex);
+
+		sleeping.fetch_add(1);
+		wake.wait(lock, [this] { return pending.load() || stopping; });
+		sleeping.fetch_sub(1);
+
+		if (stopping && !pending.load()) break;
+	}
+
+	self.LogInfo("Stopping");
+
+	currentPool = nullptr;
+}
+}
\ No newline at end of file
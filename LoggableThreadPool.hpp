@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "Logger.hpp"
+
+namespace Fetcko {
+class LoggableThreadPool;
+
+// What the pool queues. Like std::function<void()>, but move only, so
+// a task can own things that can't be copied (a std::unique_ptr, say).
+class PoolTask {
+public:
+	PoolTask() = default;
+
+	template<typename F, typename = std::enable_if_t<!std::is_same<std::decay_t<F>, PoolTask>::value>>
+	PoolTask(F &&f) : callable(std::make_unique<Callable<std::decay_t<F>>>(std::forward<F>(f))) {}
+
+	void operator()() { callable->Call(); }
+
+	explicit operator bool() const { return callable != nullptr; }
+
+private:
+	struct Base {
+		virtual ~Base() = default;
+		virtual void Call() = 0;
+	};
+
+	template<typename F>
+	struct Callable : Base {
+		template<typename G>
+		explicit Callable(G &&g) : f(std::forward<G>(g)) {}
+
+		void Call() override { f(); }
+
+		F f;
+	};
+
+	std::unique_ptr<Base> callable;
+};
+
+// What LoggableThreadPool::Submit returns. Like std::shared_future,
+// except it can be chained with Then, and waiting on it from one of
+// the pool's own workers runs other tasks rather than blocking one.
+template<typename T>
+class PoolFuture {
+public:
+	PoolFuture() = default;
+
+	bool Valid() const { return state != nullptr; }
+	bool IsReady() const;
+
+	void Wait() const;
+
+	// Rethrows whatever the task threw
+	decltype(auto) Get() const {
+		Wait();
+		return state->future.get();
+	}
+
+	// Runs f with this future's value (or with nothing, for void) once
+	// it's ready, as a task of its own. If this future threw, f is
+	// skipped and the returned future throws the same thing.
+	template<typename F>
+	auto Then(F &&f) const;
+
+private:
+	friend class LoggableThreadPool;
+
+	template<typename>
+	friend class PoolFuture;
+
+	struct State {
+		std::promise<T> promise;
+		std::shared_future<T> future = promise.get_future().share();
+
+		// Guards done and continuations
+		std::mutex mutex;
+		bool done = false;
+		std::vector<PoolTask> continuations;
+	};
+
+	std::shared_ptr<State> state;
+	LoggableThreadPool *pool = nullptr;
+};
+
+// A fixed set of named LoggableThreads, each with its own deque of
+// tasks. A worker takes its own newest task first (it's likely still
+// in cache) and when it runs out, steals the oldest from the others.
+// Tasks submitted by a worker go on that worker's deque; anything
+// else is dealt round robin.
+//
+//	LoggableThreadPool pool("Loader");
+//	auto size = pool.Submit([&] { return Utils::GetStringFromFile(path); })
+//		.Then([](const std::string &text) { return text.size(); });
+//	pool.ParallelFor(0, files.size(), [&](std::size_t i) { Transcode(files[i]); });
+//
+// Workers are named "<name> #<index>" and log when they start and
+// stop, at Info.
+class LoggableThreadPool : public LoggableClass {
+public:
+	// Zero threads means one per hardware thread
+	explicit LoggableThreadPool(std::string &&name, std::size_t threads = 0);
+
+	// One worker per placement, e.g. one per Topology::PhysicalCores
+	LoggableThreadPool(std::string &&name, const std::vector<ThreadPlacement> &placements);
+
+	// Runs everything already queued, then joins the workers
+	~LoggableThreadPool();
+
+	LoggableThreadPool(const LoggableThreadPool &) = delete;
+	LoggableThreadPool &operator=(const LoggableThreadPool &) = delete;
+
+	template<typename F>
+	auto Submit(F &&f) {
+		using R = std::invoke_result_t<std::decay_t<F> &>;
+
+		PoolFuture<R> ret;
+		ret.state = std::make_shared<typename PoolFuture<R>::State>();
+		ret.pool = this;
+
+		Push([state = ret.state, f = std::forward<F>(f)]() mutable { Run<R>(*state, f); });
+
+		return ret;
+	}
+
+	// Calls f(i) for every i in [begin, end), in chunks of grain
+	// (by default, enough for about four chunks per worker).
+	// Returns once they've all run; rethrows the first exception.
+	template<typename Index, typename F>
+	void ParallelFor(Index begin, Index end, F &&f, std::size_t grain = 0) {
+		static_assert(std::is_integral<Index>::value, "ParallelFor takes an integer range");
+
+		std::vector<PoolFuture<void>> chunks;
+
+		ForEachChunk(begin, end, grain, [&](Index first, Index last) {
+			chunks.push_back(Submit([&f, first, last] {
+				for (auto i = first; i < last; ++i)
+					f(i);
+			}));
+		});
+
+		// f lives on our stack, so nothing can still be using
+		// it by the time an exception leaves here
+		for (const auto &chunk : chunks)
+			chunk.Wait();
+
+		for (const auto &chunk : chunks)
+			chunk.Get();
+	}
+
+	// Folds combine(accumulator, map(i)) over [begin, end). Each chunk
+	// starts from identity, and the chunks' results are combined in
+	// order, so combine has to be associative but needn't commute.
+	template<typename Index, typename T, typename Map, typename Combine>
+	T ParallelReduce(Index begin, Index end, T identity, Map &&map, Combine &&combine, std::size_t grain = 0) {
+		static_assert(std::is_integral<Index>::value, "ParallelReduce takes an integer range");
+
+		std::vector<PoolFuture<T>> chunks;
+
+		ForEachChunk(begin, end, grain, [&](Index first, Index last) {
+			chunks.push_back(Submit([&map, &combine, &identity, first, last] {
+				T ret = identity;
+				for (auto i = first; i < last; ++i)
+					ret = combine(std::move(ret), map(i));
+				return ret;
+			}));
+		});
+
+		for (const auto &chunk : chunks)
+			chunk.Wait();
+
+		T ret = std::move(identity);
+		for (const auto &chunk : chunks)
+			ret = combine(std::move(ret), chunk.Get());
+
+		return ret;
+	}
+
+	std::size_t Size() const { return workers.size(); }
+
+	// Runs one queued task on the calling thread, if there is one.
+	// Returns whether it did.
+	bool RunPending();
+
+private:
+	template<typename>
+	friend class PoolFuture;
+
+	using Task = PoolTask;
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		std::unique_ptr<LoggableThread> thread;
+	};
+
+	template<typename R, typename F>
+	static void Run(typename PoolFuture<R>::State &state, F &f) {
+		try {
+			if constexpr (std::is_void<R>::value) {
+				f();
+				state.promise.set_value();
+			} else {
+				state.promise.set_value(f());
+			}
+		} catch (...) {
+			state.promise.set_exception(std::current_exception());
+		}
+
+		std::vector<PoolTask> continuations;
+		{
+			std::unique_lock lock(state.mutex);
+			state.done = true;
+			continuations.swap(state.continuations);
+		}
+
+		for (auto &continuation : continuations)
+			continuation();
+	}
+
+	template<typename Index, typename F>
+	void ForEachChunk(Index begin, Index end, std::size_t grain, F &&f) const {
+		if (!(begin < end)) return;
+
+		const auto count = static_cast<std::size_t>(end - begin);
+		if (!grain) grain = std::max<std::size_t>(1, count / (Size() * 4));
+
+		for (std::size_t first = 0; first < count; first += grain)
+			f(static_cast<Index>(begin + first), static_cast<Index>(begin + std::min(count, first + grain)));
+	}
+
+	template<typename T>
+	void WaitFor(const std::shared_future<T> &future) {
+		if (currentPool != this) {
+			future.wait();
+			return;
+		}
+
+		// Blocking here could leave every worker waiting on
+		// tasks that no one is left to run
+		while (future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			if (!RunPending())
+				std::this_thread::yield();
+		}
+	}
+
+	void Start(const std::vector<ThreadPlacement> &placements);
+
+	void Push(Task &&task);
+	bool TryTake(Task &task);
+	void WorkerLoop(std::size_t index);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+
+	// Tasks sitting in a deque, and workers asleep waiting for one
+	std::atomic<std::size_t> pending = 0;
+	std::atomic<std::size_t> sleeping = 0;
+
+	// Where the next task from outside the pool goes
+	std::atomic<std::size_t> nextWorker = 0;
+
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+
+	// Both guarded by wakeMutex when set
+	bool started = false;
+	std::atomic<bool> stopping = false;
+
+	// Which pool, and which of its workers, this thread is
+	static thread_local LoggableThreadPool *currentPool;
+	static thread_local std::size_t currentWorker;
+};
+
+template<typename T>
+bool PoolFuture<T>::IsReady() const {
+	return state->future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+template<typename T>
+void PoolFuture<T>::Wait() const {
+	pool->WaitFor(state->future);
+}
+
+template<typename T>
+template<typename F>
+auto PoolFuture<T>::Then(F &&f) const {
+	auto next = [previous = *this, f = std::forward<F>(f)]() mutable {
+		if constexpr (std::is_void<T>::value) {
+			previous.Get();
+			return f();
+		} else {
+			return f(previous.Get());
+		}
+	};
+
+	using R = std::invoke_result_t<decltype(next) &>;
+
+	PoolFuture<R> ret;
+	ret.state = std::make_shared<typename PoolFuture<R>::State>();
+	ret.pool = pool;
+
+	auto schedule = [pool = pool, state = ret.state, next = std::move(next)]() mutable {
+		pool->Push([state = std::move(state), next = std::move(next)]() mutable { LoggableThreadPool::Run<R>(*state, next); });
+	};
+
+	{
+		std::unique_lock lock(state->mutex);
+
+		if (!state->done) {
+			state->continuations.emplace_back(std::move(schedule));
+			return ret;
+		}
+	}
+
+	schedule();
+	return ret;
+}
+}
\ No newline at end of file
@@ -1,7 +1,28 @@
 #include "Logger.hpp"
 
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <string>
+#include <utility>
 
+#if __has_include(<cxxabi.h>)
+	#include <cxxabi.h>
+	#define FETCKO_HAS_CXXABI
+#endif
+
+#ifndef WIN32
+	#include <pthread.h>
+	#include <unistd.h>
+#endif
+
+#include "Hash.hpp"
+#include "LogRateLimiter.hpp"
+#include "LogSink.hpp"
 #include "Utils.hpp"
 
 #ifdef WIN32
@@ -21,23 +42,48 @@ namespace Fetcko {
 // =========== Initializing Statics ==============
 // ===============================================
 std::mutex Logger::mutex;
-std::map<std::string, Logger::Command> Logger::commands;
-std::queue<std::pair<Logger::Command, std::vector<std::string>>> Logger::commandQueue;
+Logger::CommandTable Logger::commands;
+std::vector<Logger::QueuedCommand> Logger::commandQueue;
+std::vector<std::string> Logger::spareLines;
 
-std::size_t Logger::maxClassNameWidth = 0;
+std::mutex Logger::commandMutex;
+std::atomic<bool> Logger::hasCommands = false;
 
-std::thread Logger::StartReadThread() {
-	std::thread ret { [] {
-		std::string line;
-		while (true) {
-			std::getline(std::cin, line);
+std::atomic<uint64_t> Logger::commandsExecuted = 0;
+std::atomic<uint64_t> Logger::commandsPending = 0;
+std::atomic<uint64_t> Logger::commandWaitTotal = 0;
+std::atomic<uint64_t> Logger::commandWaitMax = 0;
+std::atomic<uint64_t> Logger::commandRunTotal = 0;
+std::atomic<uint64_t> Logger::commandRunMax = 0;
 
-			if (auto split = Fetcko::Utils::Split(line, ' '); !split.empty()) {
-				std::unique_lock lock(mutex);
-				if (auto iter = commands.find(split[0]); iter != commands.end())
-					commandQueue.emplace(std::make_pair(iter->second, split));// iter->second(split);
-			}
-			std::cout << " > ";
+std::atomic<std::size_t> Logger::maxClassNameWidth = 0;
+
+std::mutex Logger::placementMutex;
+ThreadPlacement Logger::threadPlacement;
+#ifndef WIN32
+pid_t Logger::readThreadId = 0;
+#endif
+
+void Logger::StartReadThread() {
+	readThreadStarted = true;
+
+#ifdef WIN32
+	std::thread thread { [] {
+		ThreadPlacement placement;
+		{
+			std::unique_lock lock(placementMutex);
+			placement = threadPlacement;
+		}
+
+		if (!placement.IsEmpty())
+			placement.Apply();
+
+		// Stops at the end of input, rather than
+		// spinning on a closed or redirected stdin
+		std::string line;
+		while (std::getline(std::cin, line)) {
+			QueueCommand(line);
+			std::cout << Prompt;
 		}
 	} };
 
@@ -45,40 +91,343 @@ std::thread Logger::StartReadThread() {
 	// so we can never reliably join this thread.
 	// Instead, we'll let it die when the process
 	// ends.
-	ret.detach();
+	thread.detach();
+#else
+	StartConsole();
+	if (!console) return;
 
-	return ret;
+	// Regular files can't be waited on, but never block either
+	if (!console->AddReader(STDIN_FILENO, [] { ReadConsoleInput(); }))
+		console->Post([] { while (ReadConsoleInput()); });
+#endif
+}
+
+#ifndef WIN32
+namespace {
+// How often the console thread flushes idle sinks
+constexpr std::chrono::seconds ConsoleTimerPeriod(1);
+}
+
+void Logger::StartConsole() {
+	if (console) return;
+
+	auto reactor = std::make_unique<Reactor>();
+	if (!reactor->IsValid()) return;
+
+	reactor->AddTimer(ConsoleTimerPeriod, OnConsoleTimer);
+	console = std::move(reactor);
+
+	consoleThread = std::thread([] {
+		ThreadPlacement placement;
+		{
+			std::unique_lock lock(placementMutex);
+			placement = threadPlacement;
+			readThreadId = ThreadPlacement::CurrentThreadId();
+		}
+
+		if (!placement.IsEmpty())
+			placement.Apply();
+
+		console->Run();
+	});
+}
+
+void Logger::StopConsole() {
+	{
+		std::unique_lock lock(commandMutex);
+		if (!console) return;
+	}
+
+	console->Stop();
+
+	// exit called from a handler (OnClose, say) lands here on the
+	// console thread itself, which can't join itself
+	if (consoleThread.get_id() == std::this_thread::get_id())
+		consoleThread.detach();
+	else if (consoleThread.joinable())
+		consoleThread.join();
+}
+
+Reactor *Logger::GetReactor() {
+	std::unique_lock lock(commandMutex);
+	StartConsole();
+
+	return console.get();
+}
+
+bool Logger::ReadConsoleInput() {
+	// Whatever's left of a line that hasn't ended yet
+	static std::string input;
+
+	char chunk[4096];
+	const auto got = read(STDIN_FILENO, chunk, sizeof(chunk));
+
+	if (got < 0 && (errno == EINTR || errno == EAGAIN))
+		return true;
+
+	if (got <= 0) {
+		console->RemoveReader(STDIN_FILENO);
+
+		if (!input.empty()) {
+			QueueCommand(input);
+			input.clear();
+		}
+
+		return false;
+	}
+
+	input.append(chunk, static_cast<std::size_t>(got));
+
+	for (auto newline = input.find('\n'); newline != std::string::npos; newline = input.find('\n')) {
+		auto line = std::string_view(input).substr(0, newline);
+		if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+		QueueCommand(line);
+		input.erase(0, newline + 1);
+
+		std::cout << Prompt << std::flush;
+	}
+
+	return true;
+}
+
+void Logger::OnConsoleTimer() {
+	// Sinks that hold output back for a while (CompressedFileSink's
+	// flushAfter, MappedFileSink's rotateAfter) only check the time
+	// when flushed, which would otherwise wait for the next message
+	{
+		auto lock = LockMutex();
+		FlushSinks();
+	}
+
+	if (const auto window = collapseWindow.load(std::memory_order_relaxed); window && !IsAsync())
+		FlushRepeats(Timestamp::Now() - window);
+
+	// Bursts from sites that have since gone quiet
+	FlushSuppressed(Timestamp::Now() / 1000000000);
+}
+
+bool Logger::HandleCloseSignals(std::vector<int> signals) {
+	sigset_t set;
+	sigemptyset(&set);
+
+	for (const auto signal : signals)
+		sigaddset(&set, signal);
+
+	if (pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0) return false;
+
+	auto *reactor = GetReactor();
+	if (!reactor) return false;
+
+	// The console thread may have started before they were blocked
+	reactor->Post([set] { pthread_sigmask(SIG_BLOCK, &set, nullptr); });
+
+	return reactor->AddSignals(signals, OnCloseSignal);
+}
+
+void Logger::OnCloseSignal(int signal) {
+	if (const auto &onClose = GetOnClose(); onClose) {
+		onClose();
+		return;
+	}
+
+	// Nobody wants it, so it does what it would have
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, signal);
+
+	std::signal(signal, SIG_DFL);
+	pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+	raise(signal);
+}
+#endif
+
+bool Logger::QueueCommand(std::string_view line) {
+	thread_local std::vector<std::string_view> tokens;
+
+	Utils::Tokenize(line, tokens);
+	if (tokens.empty()) return false;
+
+	std::unique_lock lock(commandMutex);
+	auto command = commands.Find(tokens[0]);
+	if (!command) return false;
+
+	std::string text;
+	if (!spareLines.empty()) {
+		text = std::move(spareLines.back());
+		spareLines.pop_back();
+	}
+
+	text.assign(line.data(), line.size());
+
+	commandQueue.push_back({ *command, std::move(text), std::chrono::steady_clock::now() });
+	commandsPending.fetch_add(1, std::memory_order_relaxed);
+
+	return true;
 }
 
-std::atomic<bool> Logger::processingCommands = false;
+void Logger::SetReadThreadEnabled(bool enabled) {
+	std::unique_lock lock(commandMutex);
+	readThreadEnabled = enabled;
+
+	if (enabled && !readThreadStarted && !commands.Empty())
+		StartReadThread();
+}
+
+namespace {
+void UpdateMax(std::atomic<uint64_t> &max, uint64_t value) {
+	auto current = max.load(std::memory_order_relaxed);
+	while (current < value && !max.compare_exchange_weak(current, value, std::memory_order_relaxed));
+}
+}
 
 void Logger::ProcessCommands() {
+	// Reused between calls so swapping doesn't allocate
+	thread_local std::vector<QueuedCommand> running;
+	thread_local std::vector<std::string_view> tokens;
+
+	// Without a writer thread, this is the only timer
+	// a run from an object that's gone quiet will get
+	if (const auto window = collapseWindow.load(std::memory_order_relaxed); window && !IsAsync())
+		FlushRepeats(Timestamp::Now() - window);
+
+	{
+		std::unique_lock lock(commandMutex);
+		if (commandQueue.empty()) return;
+		running.swap(commandQueue);
+	}
+
+	for (auto &[f, line, queued] : running) {
+		Utils::Tokenize(std::string_view(line), tokens);
+
+		const auto start = std::chrono::steady_clock::now();
+		(*f)(Arguments(tokens));
+		const auto end = std::chrono::steady_clock::now();
+
+		const auto wait = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - queued).count());
+		const auto run = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+
+		commandWaitTotal.fetch_add(wait, std::memory_order_relaxed);
+		commandRunTotal.fetch_add(run, std::memory_order_relaxed);
+		UpdateMax(commandWaitMax, wait);
+		UpdateMax(commandRunMax, run);
+
+		commandsExecuted.fetch_add(1, std::memory_order_relaxed);
+		commandsPending.fetch_sub(1, std::memory_order_relaxed);
+	}
+
 	{
-		std::unique_lock lock(mutex);
-		processingCommands = true;
-		while (!commandQueue.empty()) {
-			auto &[f, split] = commandQueue.front();
-			f(split);
-			commandQueue.pop();
+		// A burst of commands shouldn't keep its lines forever
+		constexpr std::size_t MaxSpareLines = 16;
+
+		std::unique_lock lock(commandMutex);
+
+		for (auto &queued : running) {
+			if (spareLines.size() < MaxSpareLines)
+				spareLines.push_back(std::move(queued.line));
 		}
 	}
-	processingCommands = false;
+
+	running.clear();
+}
+
+Logger::CommandStats Logger::GetCommandStats() {
+	return {
+		commandsExecuted.load(std::memory_order_relaxed),
+		commandsPending.load(std::memory_order_relaxed),
+		commandWaitTotal.load(std::memory_order_relaxed),
+		commandWaitMax.load(std::memory_order_relaxed),
+		commandRunTotal.load(std::memory_order_relaxed),
+		commandRunMax.load(std::memory_order_relaxed)
+	};
 }
 
-std::thread Logger::readThread = Logger::StartReadThread();
+// The read thread is started by the first AddCommands,
+// so static initialization never creates a thread
+bool Logger::readThreadStarted = false;
+bool Logger::readThreadEnabled = true;
+
+#ifndef WIN32
+std::unique_ptr<Reactor> Logger::console;
+std::thread Logger::consoleThread;
+int Logger::statsTimer = -1;
+#endif
 
 Logger::Level Logger::logLevel = Logger::Level::Debug;
 
 std::function<void()> Logger::onClose;
 
+std::vector<std::shared_ptr<LogSink>> Logger::sinks = { std::make_shared<ConsoleSink>() };
+std::atomic<unsigned> Logger::formats = static_cast<unsigned>(Logger::Format::Text);
+
+std::atomic<bool> Logger::async = false;
+std::unique_ptr<MpscRingBuffer<Logger::Record>> Logger::buffer;
+Logger::OverflowPolicy Logger::overflowPolicy = Logger::OverflowPolicy::Block;
+std::atomic<std::size_t> Logger::dropped = 0;
+std::size_t Logger::droppedReported = 0;
+std::atomic<unsigned> Logger::producers = 0;
+
+std::atomic<bool> Logger::deferred = false;
+std::unique_ptr<MpscRingBuffer<Logger::Deferred>> Logger::binaryBuffer;
+std::atomic<uint64_t> Logger::recordSequence = 0;
+std::ofstream Logger::binaryFile;
+
+std::thread Logger::writerThread;
+std::mutex Logger::writerMutex;
+std::condition_variable Logger::writerWake;
+std::atomic<bool> Logger::writerIdle = false;
+std::atomic<bool> Logger::writerStopping = false;
+
+std::array<std::atomic<uint64_t>, 4> Logger::messagesWritten {};
+std::atomic<uint64_t> Logger::bytesWritten = 0;
+
+std::atomic<uint64_t> Logger::lockContended = 0;
+std::atomic<uint64_t> Logger::lockWaitTotal = 0;
+std::atomic<uint64_t> Logger::lockWaitMax = 0;
+
+std::atomic<bool> Logger::trackLatency = false;
+LatencyHistogram Logger::latency;
+
+FlightRecorder *Logger::flightRecorder = nullptr;
+std::atomic<int> Logger::recorderLevel = Logger::NotRecorded;
+
+std::atomic<uint64_t> Logger::levelEpoch = 1;
+std::atomic<int> Logger::lowestOverride = Logger::NotRecorded;
+std::atomic<int> Logger::lowestOwnLevel = Logger::NotRecorded;
+
+std::shared_mutex Logger::levelMutex;
+std::map<std::string, Logger::Level, std::less<>> Logger::classLevels;
+std::map<std::string, Logger::Level, std::less<>> Logger::instanceLevels;
+
+std::atomic<int64_t> Logger::collapseWindow = 0;
+std::atomic<uint64_t> Logger::collapseEpoch = 0;
+std::atomic<uint64_t> Logger::messagesCollapsed = 0;
+
+std::mutex Logger::repeatMutex;
+std::map<const Logger *, Logger::Repeat> Logger::repeats;
+std::map<LogRateLimiter *, Logger::Repeat> Logger::suppressedSites;
+std::atomic<int64_t> Logger::oldestRepeat = std::numeric_limits<int64_t>::max();
+
+// A joinable std::thread at exit calls std::terminate, so make
+// sure the writer and console threads are gone before the statics above.
+static struct AsyncShutdown {
+	~AsyncShutdown() {
+#ifndef WIN32
+		Logger::StopConsole();
+#endif
+		Logger::FlushRepeats();
+		Logger::StopAsync();
+	}
+} asyncShutdown;
+
 // ===============================================
 // ============= Member Functions ================
 // ===============================================
 void Logger::AddCommands(std::map<std::string, Command> &&commands) {
-	std::unique_lock lock(mutex);
+	std::unique_lock lock(commandMutex);
 
 	// When we first add commands, initialize a console window
-	if (Logger::commands.empty() && !commands.empty()) {
+	if (Logger::commands.Empty() && !commands.empty()) {
 #ifdef WIN32
 		AllocConsole();
 		AttachConsole(ATTACH_PARENT_PROCESS);
@@ -87,18 +436,1216 @@ void Logger::AddCommands(std::map<std::string, Command> &&commands) {
 
 		SetConsoleCtrlHandler(ConsoleHandlerRoutine, true);
 #endif
+
+		Logger::commands.Insert("logstats", PrintStats);
+		Logger::commands.Insert("loglevel", LevelCommand);
+		Logger::commands.Insert("flightdump", [](Arguments arguments) {
+			// flightdump [path]
+			const auto path = arguments.size() > 1 ? std::filesystem::u8path(arguments[1]) : std::filesystem::path();
+
+			std::unique_lock lock(mutex);
+			if (!flightRecorder)
+				std::cout << "\rThe flight recorder isn't running\n";
+			else if (DumpFlightRecorder(path))
+				std::cout << "\rDumped the flight recorder to " << (path.empty() ? flightRecorder->GetDumpPath() : path).u8string() << '\n';
+			else
+				std::cout << "\rCouldn't dump the flight recorder\n";
+
+			PrintPrompt();
+		});
+		Logger::commands.Insert("trace", [](Arguments arguments) {
+			// trace on | off | write <path>
+			const auto action = arguments.size() > 1 ? arguments[1] : std::string_view();
+
+			std::unique_lock lock(mutex);
+			if (action == "on") {
+				Tracer::Enable();
+				std::cout << "\rTracing\n";
+			} else if (action == "off") {
+				Tracer::Disable();
+				std::cout << "\rStopped tracing\n";
+			} else if (action == "write" && arguments.size() > 2) {
+				const auto path = std::filesystem::u8path(arguments[2]);
+				if (Tracer::WriteChromeTrace(path))
+					std::cout << "\rWrote the trace to " << path.u8string() << '\n';
+				else
+					std::cout << "\rCouldn't write the trace to " << path.u8string() << '\n';
+			} else {
+				std::cout << "\rUsage: trace on | off | write <path>\n";
+			}
+
+			PrintPrompt();
+		});
+	}
+	for (auto &[name, command] : commands)
+		Logger::commands.Insert(std::string(name), std::move(command));
+
+	hasCommands = !Logger::commands.Empty();
+
+	if (readThreadEnabled && !readThreadStarted && hasCommands)
+		StartReadThread();
+}
+
+bool Logger::CommandTable::Insert(std::string &&name, Command &&command) {
+	// Keep at most half the slots full so probes stay short
+	if ((count + 1) * 2 > entries.size())
+		Grow();
+
+	const auto hash = hash_32_fnv1a_const(name.data(), name.size());
+	const auto mask = entries.size() - 1;
+
+	for (auto i = hash & mask; ; i = (i + 1) & mask) {
+		auto &entry = entries[i];
+
+		if (!entry.command) {
+			entry = { hash, std::move(name), std::make_shared<const Command>(std::move(command)) };
+			++count;
+			return true;
+		}
+
+		if (entry.hash == hash && entry.name == name)
+			return false;
+	}
+}
+
+const std::shared_ptr<const Logger::Command> *Logger::CommandTable::Find(std::string_view name) const {
+	if (entries.empty()) return nullptr;
+
+	const auto hash = hash_32_fnv1a_const(name.data(), name.size());
+	const auto mask = entries.size() - 1;
+
+	for (auto i = hash & mask; entries[i].command; i = (i + 1) & mask) {
+		if (entries[i].hash == hash && entries[i].name == name)
+			return &entries[i].command;
+	}
+
+	return nullptr;
+}
+
+void Logger::CommandTable::Grow() {
+	auto old = std::move(entries);
+
+	entries.clear();
+	entries.resize(old.empty() ? 16 : old.size() * 2);
+	count = 0;
+
+	const auto mask = entries.size() - 1;
+	for (auto &entry : old) {
+		if (!entry.command) continue;
+
+		auto i = entry.hash & mask;
+		while (entries[i].command) i = (i + 1) & mask;
+
+		entries[i] = std::move(entry);
+		++count;
+	}
+}
+
+namespace {
+struct InternedClass {
+	std::atomic<const std::type_info *> type = nullptr;
+
+	// Zero until the name has been measured
+	std::atomic<std::size_t> length = 0;
+};
+
+// Open addressing by type_info address. Entries are never removed,
+// so a lookup only ever probes past classes that have logged.
+constexpr std::size_t InternedClassBits = 10;
+std::array<InternedClass, std::size_t(1) << InternedClassBits> internedClasses;
+}
+
+std::string_view Logger::InternClassName(const std::type_info &type) {
+	const auto *name = type.name();
+
+	// Fibonacci hashing: the top bits of the product are well mixed
+	const auto mask = internedClasses.size() - 1;
+	const auto start = static_cast<std::size_t>((static_cast<uint64_t>(reinterpret_cast<uintptr_t>(&type)) * 0x9E3779B97F4A7C15ull) >> (64 - InternedClassBits));
+
+	for (std::size_t probe = 0; probe < internedClasses.size(); ++probe) {
+		auto &entry = internedClasses[(start + probe) & mask];
+		auto *current = entry.type.load(std::memory_order_acquire);
+
+		if (!current && entry.type.compare_exchange_strong(current, &type, std::memory_order_acq_rel)) {
+			const auto length = std::strlen(name);
+
+			auto width = maxClassNameWidth.load(std::memory_order_relaxed);
+			while (width < length && !maxClassNameWidth.compare_exchange_weak(width, length));
+
+			entry.length.store(length, std::memory_order_release);
+			return { name, length };
+		}
+
+		if (current == &type) {
+			if (const auto length = entry.length.load(std::memory_order_acquire))
+				return { name, length };
+
+			// Another thread is measuring it right now
+			break;
+		}
+	}
+
+	// Only if the table is full, or we lost the race above
+	const std::string_view ret(name);
+
+	auto width = maxClassNameWidth.load(std::memory_order_relaxed);
+	while (width < ret.size() && !maxClassNameWidth.compare_exchange_weak(width, ret.size()));
+
+	return ret;
+}
+
+std::string_view Logger::GetClassName() const {
+	return InternClassName(typeid(*object));
+}
+
+const std::string &Logger::GetObjectName() const {
+	return object->GetName();
+}
+
+Logger::State &Logger::GetState() const {
+	if (auto *current = state.load(std::memory_order_acquire))
+		return *current;
+
+	auto *fresh = new State;
+	State *current = nullptr;
+
+	if (state.compare_exchange_strong(current, fresh, std::memory_order_acq_rel))
+		return *fresh;
+
+	// Another thread got there first
+	delete fresh;
+	return *current;
+}
+
+void Logger::CheckType(State &state) const {
+	const auto *type = &typeid(*object);
+	if (state.type.load(std::memory_order_relaxed) == type) return;
+
+	// Stale first, so anyone who sees the new type sees that too
+	state.header.fetch_or(Stale, std::memory_order_release);
+	state.levels.fetch_and(~(EpochMask << EpochShift), std::memory_order_release);
+	state.type.store(type, std::memory_order_release);
+}
+
+const Logger::Header &Logger::GetHeader() const {
+	auto &state = GetState();
+	CheckType(state);
+
+	auto &header = state.header;
+	auto current = header.load(std::memory_order_acquire);
+
+	while (!current || (current & Stale)) {
+		auto *fresh = new Header(BuildHeader());
+		fresh->previous.reset(ToHeader(current));
+
+		if (header.compare_exchange_strong(current, reinterpret_cast<uintptr_t>(fresh), std::memory_order_acq_rel))
+			return *fresh;
+
+		// Another thread got there first. Use theirs,
+		// unless it's been marked stale again since.
+		fresh->previous.release();
+		delete fresh;
+	}
+
+	return *ToHeader(current);
+}
+
+Logger::Header Logger::BuildHeader() const {
+	Header ret;
+
+	// Whatever class typeid sees right now, which inside a base
+	// class constructor is the base. CheckType catches that later.
+	const auto className = GetClassName();
+	ret.classNameLength = className.size();
+	ret.width = std::max(maxClassNameWidth.load(std::memory_order_relaxed), className.size());
+
+	std::ostringstream stream;
+	stream << className << std::string(ret.width - className.size(), ' ');
+
+	if (const auto &name = GetObjectName(); name.size())
+		stream << " (" << name << ")";
+
+	WriteAddress(stream, object);
+
+	ret.text = stream.str();
+
+	return ret;
+}
+
+void Logger::WriteHeader(std::ostream &out, Level level, int64_t nanoseconds) const {
+	const auto &header = GetHeader();
+	char time[Timestamp::MaxLength];
+
+	const auto label = Labels[static_cast<std::size_t>(level)];
+	const auto timestamp = Timestamp::Format(nanoseconds, time);
+
+	out.write(label.data(), label.size());
+	out.write(timestamp.data(), timestamp.size());
+	out.write(") ", 2);
+
+	if (const auto width = maxClassNameWidth.load(std::memory_order_relaxed); width > header.width) {
+		out.write(header.text.data(), header.classNameLength);
+		out << std::string(width - header.width, ' ');
+		out.write(header.text.data() + header.classNameLength, header.text.size() - header.classNameLength);
+	} else {
+		out.write(header.text.data(), header.text.size());
+	}
+}
+
+void Logger::WriteAddress(std::ostream &out, const void *address) {
+	char text[AddressLength];
+	const auto formatted = FormatAddress(address, text);
+
+	out << " [";
+	out.write(formatted.data(), formatted.size());
+	out << "]: ";
+}
+
+std::string_view Logger::FormatAddress(const void *address, char *out) {
+	// Not streamed as a pointer: how that looks varies by
+	// standard library (MSVC pads with zeros and leaves off
+	// the 0x, libstdc++ adds it).
+	constexpr std::string_view Digits = "0123456789abcdef";
+
+	auto value = reinterpret_cast<uintptr_t>(address);
+	auto *end = out + AddressLength;
+	auto *begin = end;
+
+	do {
+		*--begin = Digits[value & 0xF];
+		value >>= 4;
+	} while (value);
+
+	*--begin = 'x';
+	*--begin = '0';
+
+	return { begin, static_cast<std::size_t>(end - begin) };
+}
+
+void Logger::FormatHeader(
+	std::ostream &out,
+	Level level,
+	int64_t nanoseconds,
+	std::string_view className,
+	std::string_view name,
+	const void *address
+) {
+	char time[Timestamp::MaxLength];
+
+	out
+		<< Labels[static_cast<std::size_t>(level)]
+		<< Timestamp::Format(nanoseconds, time)
+		<< ") "
+		<< std::setw(maxClassNameWidth)
+		<< std::left
+		<< std::setfill(' ')
+		<< className;
+
+	if (name.size()) {
+		out
+			<< " ("
+			<< name
+			<< ")";
+	}
+
+	WriteAddress(out, address);
+}
+
+void Logger::FormatJsonHeader(
+	JsonWriter &out,
+	Level level,
+	int64_t nanoseconds,
+	std::string_view className,
+	std::string_view name,
+	const void *address
+) {
+	char text[AddressLength];
+
+	out.Field("ts", nanoseconds);
+	out.Field("level", LevelNames[static_cast<std::size_t>(level)]);
+	out.Field("class", className);
+
+	if (name.size())
+		out.Field("name", name);
+
+	out.Field("address", FormatAddress(address, text));
+}
+
+void Logger::Submit(Level level, int64_t nanoseconds, std::string &&text, std::string &&json) {
+	if (IsAsync()) {
+		Producing producing;
+
+		if (async.load()) {
+			Push(*buffer, [&](Record &record) {
+				record.level = level;
+				record.nanoseconds = nanoseconds;
+				record.sequence = IsDeferred() ? recordSequence.fetch_add(1, std::memory_order_release) : Unnumbered;
+				record.text = std::move(text);
+				record.json = std::move(json);
+			});
+
+			return;
+		}
+	}
+
+	auto lock = LockMutex();
+
+	WriteRecord({ level, nanoseconds, std::move(text), std::move(json) });
+	FlushSinks();
+}
+
+void Logger::WriteRecord(const Record &record) {
+	for (const auto &sink : sinks) {
+		const auto &line = sink->GetFormat() == Format::JsonLines ? record.json : record.text;
+
+		if (line.size() && sink->Accepts(record.level)) {
+			sink->WriteTimed(record.level, record.nanoseconds, line);
+			bytesWritten.fetch_add(line.size() + 1, std::memory_order_relaxed);
+		}
+	}
+
+	messagesWritten[static_cast<std::size_t>(record.level)].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::unique_lock<std::mutex> Logger::LockMutex() {
+	std::unique_lock lock(mutex, std::try_to_lock);
+	if (lock.owns_lock()) return lock;
+
+	// Only read the clock when we actually have to wait
+	const auto start = std::chrono::steady_clock::now();
+	lock.lock();
+	const auto wait = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+	lockContended.fetch_add(1, std::memory_order_relaxed);
+	lockWaitTotal.fetch_add(wait, std::memory_order_relaxed);
+	UpdateMax(lockWaitMax, wait);
+
+	return lock;
+}
+
+Logger::Stats Logger::GetStats() {
+	Stats ret;
+
+	for (std::size_t i = 0; i < ret.messages.size(); ++i)
+		ret.messages[i] = messagesWritten[i].load(std::memory_order_relaxed);
+
+	ret.bytes = bytesWritten.load(std::memory_order_relaxed);
+
+	ret.lockContended = lockContended.load(std::memory_order_relaxed);
+	ret.lockWaitTotal = lockWaitTotal.load(std::memory_order_relaxed);
+	ret.lockWaitMax = lockWaitMax.load(std::memory_order_relaxed);
+
+	ret.collapsed = messagesCollapsed.load(std::memory_order_relaxed);
+	ret.dropped = dropped.load(std::memory_order_relaxed);
+
+	// The buffers are only replaced while nobody is producing
+	Producing producing;
+
+	if (async.load()) {
+		ret.backlog = buffer->SizeApprox();
+		ret.capacity = buffer->Capacity();
+
+		if (IsDeferred() && binaryBuffer) {
+			ret.backlog += binaryBuffer->SizeApprox();
+			ret.capacity += binaryBuffer->Capacity();
+		}
 	}
-	Logger::commands.merge(std::move(commands));
+
+	ret.latency = latency.Read();
+
+	return ret;
 }
 
-void Logger::SetObject(LoggableClass *object) {
-	this->object = object;
+void Logger::ResetStats() {
+	for (auto &count : messagesWritten)
+		count.store(0, std::memory_order_relaxed);
 
-	std::unique_lock lock(mutex, std::defer_lock);
+	bytesWritten.store(0, std::memory_order_relaxed);
+	messagesCollapsed.store(0, std::memory_order_relaxed);
 
-	if (!processingCommands) lock.lock();
+	lockContended.store(0, std::memory_order_relaxed);
+	lockWaitTotal.store(0, std::memory_order_relaxed);
+	lockWaitMax.store(0, std::memory_order_relaxed);
 
-	if (auto width = std::strlen(typeid(*object).name()); width > maxClassNameWidth)
-		maxClassNameWidth = width;
+	latency.Reset();
+}
+
+namespace {
+// "850ns", "12.3us", "4.5ms", "2.0s"
+std::string FormatDuration(uint64_t nanoseconds) {
+	constexpr std::array<std::string_view, 3> Units = { "us", "ms", "s" };
+
+	if (nanoseconds < 1000)
+		return std::to_string(nanoseconds) + "ns";
+
+	auto value = static_cast<double>(nanoseconds) / 1000;
+	std::size_t unit = 0;
+
+	while (value >= 1000 && unit + 1 < Units.size()) {
+		value /= 1000;
+		++unit;
+	}
+
+	char text[32];
+	std::snprintf(text, sizeof(text), "%.1f", value);
+
+	return text + std::string(Units[unit]);
+}
+}
+
+void Logger::PrintStats(Arguments arguments) {
+	// logstats reset
+	// logstats latency on|off
+	// logstats every <seconds>|off
+	if (arguments.size() > 1) {
+		if (arguments[1] == "reset") {
+			ResetStats();
+		} else if (arguments[1] == "latency" && arguments.size() > 2) {
+			SetLatencyTracking(arguments[2] == "on");
+#ifndef WIN32
+		} else if (arguments[1] == "every" && arguments.size() > 2) {
+			auto *reactor = GetReactor();
+			if (reactor && statsTimer != -1)
+				reactor->RemoveTimer(std::exchange(statsTimer, -1));
+
+			// Printed from the console thread, like any other timer
+			if (const auto seconds = std::strtoul(std::string(arguments[2]).c_str(), nullptr, 10); reactor && seconds)
+				statsTimer = reactor->AddTimer(std::chrono::seconds(seconds), [] { PrintStats({}); });
+
+			return;
+#endif
+		} else {
+#ifdef WIN32
+			std::cout << "\rUsage: logstats [reset | latency on|off]\n";
+#else
+			std::cout << "\rUsage: logstats [reset | latency on|off | every <seconds>|off]\n";
+#endif
+			PrintPrompt();
+			return;
+		}
+	}
+
+	const auto stats = GetStats();
+
+	std::ostringstream out;
+	out
+		<< "\rLogger stats:\n"
+		<< "  messages   info " << stats.messages[0]
+		<< ", debug " << stats.messages[1]
+		<< ", warning " << stats.messages[2]
+		<< ", error " << stats.messages[3] << '\n'
+		<< "  bytes      " << stats.bytes << '\n'
+		<< "  collapsed  " << stats.collapsed << '\n'
+		<< "  lock wait  contended " << stats.lockContended
+		<< ", total " << FormatDuration(stats.lockWaitTotal)
+		<< ", max " << FormatDuration(stats.lockWaitMax) << '\n';
+
+	if (IsAsync()) {
+		out
+			<< "  buffer     backlog " << stats.backlog << " / " << stats.capacity
+			<< ", dropped " << stats.dropped << '\n';
+	}
+
+	if (const auto &histogram = stats.latency; histogram.count) {
+		out
+			<< "  latency    count " << histogram.count
+			<< ", mean " << FormatDuration(histogram.Mean())
+			<< ", p50 " << FormatDuration(histogram.Percentile(0.5))
+			<< ", p99 " << FormatDuration(histogram.Percentile(0.99))
+			<< ", p99.9 " << FormatDuration(histogram.Percentile(0.999))
+			<< ", max " << FormatDuration(histogram.Max()) << '\n';
+	} else {
+		out << "  latency    " << (IsTrackingLatency() ? "nothing yet" : "off (logstats latency on)") << '\n';
+	}
+
+	// Straight to the console: this answers whoever typed it,
+	// and shouldn't end up in the log files
+	std::unique_lock lock(mutex);
+	std::cout << out.str();
+	PrintPrompt();
+}
+
+void Logger::SetCollapseWindow(std::chrono::milliseconds window) {
+	collapseEpoch.fetch_add(1, std::memory_order_relaxed);
+	collapseWindow.store(std::chrono::duration_cast<std::chrono::nanoseconds>(window).count(), std::memory_order_relaxed);
+
+	// Runs counted under the old window go out now
+	FlushRepeats();
+}
+
+void Logger::FlushRepeats() {
+	FlushRepeats(std::numeric_limits<int64_t>::max());
+	FlushSuppressed(std::numeric_limits<int64_t>::max());
+}
+
+void Logger::HoldSuppressed(LogRateLimiter &limiter, Level level) const {
+	Repeat origin { level, 0, 0, 0, GetClassName(), GetObjectName(), object };
+
+	std::unique_lock lock(repeatMutex);
+	suppressedSites[&limiter] = std::move(origin);
+}
+
+void Logger::FlushSuppressed(int64_t second) {
+	std::vector<std::pair<Repeat, std::string>> ready;
+
+	{
+		std::unique_lock lock(repeatMutex);
+
+		for (auto &[limiter, origin] : suppressedSites) {
+			// The site could still carry it with its next message
+			if (limiter->GetWindow() >= second) continue;
+
+			if (const auto count = limiter->TakeSuppressed(); count) {
+				auto &[run, summary] = ready.emplace_back(origin, limiter->Summary(count));
+				run.count = count;
+				run.last = Timestamp::Now();
+			}
+		}
+	}
+
+	for (const auto &[run, summary] : ready) {
+		auto record = RenderNote(run, summary, "suppressed");
+		Submit(record.level, record.nanoseconds, std::move(record.text), std::move(record.json));
+	}
+}
+
+bool Logger::IsRepeat(int64_t nanoseconds, int64_t window, Level level, uint64_t hash) const {
+	auto &lastMessage = GetState().lastMessage;
+	hash &= ~Repeating;
+
+	bool repeat = (lastMessage.load(std::memory_order_relaxed) & ~Repeating) == hash;
+
+	if (repeat) {
+		std::unique_lock lock(repeatMutex);
+		auto &run = repeats[this];
+
+		if (!run.count) {
+			run = { level, 0, nanoseconds, nanoseconds, GetClassName(), GetObjectName(), object };
+			lastMessage.fetch_or(Repeating, std::memory_order_relaxed);
+
+			if (nanoseconds < oldestRepeat.load(std::memory_order_relaxed))
+				oldestRepeat.store(nanoseconds, std::memory_order_relaxed);
+		}
+
+		++run.count;
+		run.last = nanoseconds;
+
+		messagesCollapsed.fetch_add(1, std::memory_order_relaxed);
+	} else if (lastMessage.exchange(hash, std::memory_order_relaxed) & Repeating) {
+		// Written before the message that ended it
+		EndRepeat();
+	}
+
+	// A run that never ends still goes out once a window. So does one
+	// from an object that's gone quiet, as soon as anything else logs.
+	if (oldestRepeat.load(std::memory_order_relaxed) <= nanoseconds - window)
+		FlushRepeats(nanoseconds - window);
+
+	return repeat;
+}
+
+void Logger::EndRepeat() const {
+	Repeat run;
+
+	{
+		std::unique_lock lock(repeatMutex);
+
+		const auto found = repeats.find(this);
+		if (found == repeats.end()) return;
+
+		run = std::move(found->second);
+		repeats.erase(found);
+		GetState().lastMessage.fetch_and(~Repeating, std::memory_order_relaxed);
+
+		if (run.first <= oldestRepeat.load(std::memory_order_relaxed)) {
+			auto oldest = std::numeric_limits<int64_t>::max();
+			for (const auto &[logger, other] : repeats)
+				oldest = std::min(oldest, other.first);
+
+			oldestRepeat.store(oldest, std::memory_order_relaxed);
+		}
+	}
+
+	auto record = RenderRepeat(run);
+	Submit(record.level, record.nanoseconds, std::move(record.text), std::move(record.json));
+}
+
+std::vector<Logger::Repeat> Logger::TakeRepeats(int64_t cutoff) {
+	std::vector<Repeat> ret;
+
+	std::unique_lock lock(repeatMutex);
+	if (oldestRepeat.load(std::memory_order_relaxed) > cutoff) return ret;
+
+	auto oldest = std::numeric_limits<int64_t>::max();
+
+	for (auto it = repeats.begin(); it != repeats.end();) {
+		if (it->second.first > cutoff) {
+			oldest = std::min(oldest, it->second.first);
+			++it;
+			continue;
+		}
+
+		it->first->GetState().lastMessage.fetch_and(~Repeating, std::memory_order_relaxed);
+		ret.push_back(std::move(it->second));
+		it = repeats.erase(it);
+	}
+
+	oldestRepeat.store(oldest, std::memory_order_relaxed);
+	lock.unlock();
+
+	std::sort(ret.begin(), ret.end(), [](const Repeat &a, const Repeat &b) { return a.last < b.last; });
+	return ret;
+}
+
+void Logger::FlushRepeats(int64_t cutoff) {
+	for (const auto &run : TakeRepeats(cutoff)) {
+		auto record = RenderRepeat(run);
+		Submit(record.level, record.nanoseconds, std::move(record.text), std::move(record.json));
+	}
+}
+
+Logger::Record Logger::RenderRepeat(const Repeat &repeat) {
+	const auto message = "Last message repeated " + std::to_string(repeat.count) + (repeat.count == 1 ? " time" : " times");
+	return RenderNote(repeat, message, "repeated");
+}
+
+Logger::Record Logger::RenderNote(const Repeat &repeat, std::string_view message, std::string_view key) {
+	Record ret { repeat.level, repeat.last, {}, {} };
+
+	const auto wanted = formats.load(std::memory_order_relaxed);
+
+	if (wanted & static_cast<unsigned>(Format::Text)) {
+		auto &stream = GetStream();
+		FormatHeader(stream, repeat.level, repeat.last, repeat.className, repeat.name, repeat.address);
+		stream << message;
+
+		ret.text = stream.str();
+	}
+
+	if (wanted & static_cast<unsigned>(Format::JsonLines)) {
+		JsonWriter writer(ret.json);
+		writer.BeginObject();
+		FormatJsonHeader(writer, repeat.level, repeat.last, repeat.className, repeat.name, repeat.address);
+		writer.Field("msg", message);
+		writer.Field(key, repeat.count);
+		writer.EndObject();
+	}
+
+	return ret;
+}
+
+void Logger::FlushSinks() {
+	for (const auto &sink : sinks)
+		sink->Flush();
+}
+
+void Logger::AddSink(std::shared_ptr<LogSink> sink) {
+	std::unique_lock lock(mutex);
+	sinks.emplace_back(std::move(sink));
+	UpdateFormats();
+}
+
+void Logger::RemoveSink(const std::shared_ptr<LogSink> &sink) {
+	std::unique_lock lock(mutex);
+	sinks.erase(std::remove(sinks.begin(), sinks.end(), sink), sinks.end());
+	UpdateFormats();
+}
+
+void Logger::ClearSinks() {
+	std::unique_lock lock(mutex);
+	sinks.clear();
+	UpdateFormats();
+}
+
+void Logger::UpdateFormats() {
+	unsigned wanted = 0;
+	for (const auto &sink : sinks)
+		wanted |= static_cast<unsigned>(sink->GetFormat());
+
+	formats.store(wanted, std::memory_order_relaxed);
+}
+
+void Logger::StartFlightRecorder(const std::filesystem::path &dumpPath, Level level, std::size_t capacity, bool handleSignals) {
+	std::unique_lock lock(mutex);
+
+	if (!flightRecorder)
+		flightRecorder = new FlightRecorder(capacity, dumpPath);
+
+	if (handleSignals)
+		FlightRecorder::HandleSignals(flightRecorder);
+
+	recorderLevel.store(static_cast<int>(level), std::memory_order_release);
+}
+
+void Logger::StopFlightRecorder() {
+	recorderLevel.store(NotRecorded, std::memory_order_release);
+	FlightRecorder::HandleSignals(nullptr);
+}
+
+bool Logger::DumpFlightRecorder(const std::filesystem::path &path) {
+	if (!flightRecorder) return false;
+
+	return path.empty() ? flightRecorder->Dump() : flightRecorder->Dump(path.c_str());
+}
+
+Logger::Level Logger::RefreshThreshold() const {
+	auto &state = GetState();
+	CheckType(state);
+
+	auto &levels = state.levels;
+
+	while (true) {
+		auto bits = levels.load(std::memory_order_acquire);
+		const auto epoch = levelEpoch.load(std::memory_order_acquire) & EpochMask;
+		const auto own = (bits >> OwnShift) & LevelMask;
+
+		auto threshold = own;
+
+		if (threshold == NoOverride) {
+			std::shared_lock lock(levelMutex);
+
+			if (!instanceLevels.empty()) {
+				if (auto found = instanceLevels.find(std::string_view(GetObjectName())); found != instanceLevels.end())
+					threshold = static_cast<uint64_t>(found->second);
+			}
+
+			if (threshold == NoOverride && !classLevels.empty()) {
+				if (auto found = classLevels.find(std::string_view(ReadableClassName(typeid(*object)))); found != classLevels.end())
+					threshold = static_cast<uint64_t>(found->second);
+			}
+		}
+
+		// Fails if SetLogLevel or RefreshHeader got in since we
+		// loaded bits, in which case we go round again
+		if (levels.compare_exchange_weak(bits, (epoch << EpochShift) | (own << OwnShift) | threshold, std::memory_order_acq_rel))
+			return threshold == NoOverride ? logLevel : static_cast<Level>(threshold);
+	}
+}
+
+void Logger::SetOwnLevel(uint64_t level) {
+	// Clearing the epoch makes the next check refresh
+	auto &levels = GetState().levels;
+	auto bits = levels.load(std::memory_order_relaxed);
+	while (!levels.compare_exchange_weak(bits, (level << OwnShift) | NoOverride, std::memory_order_acq_rel));
+
+	if (level == NoOverride) return;
+
+	auto lowest = lowestOwnLevel.load(std::memory_order_relaxed);
+	while (static_cast<int>(level) < lowest && !lowestOwnLevel.compare_exchange_weak(lowest, static_cast<int>(level)));
+
+	auto current = lowestOverride.load(std::memory_order_relaxed);
+	while (static_cast<int>(level) < current && !lowestOverride.compare_exchange_weak(current, static_cast<int>(level)));
+}
+
+void Logger::LevelsChanged() {
+	auto lowest = lowestOwnLevel.load(std::memory_order_relaxed);
+
+	for (const auto &[name, level] : classLevels)
+		lowest = std::min(lowest, static_cast<int>(level));
+
+	for (const auto &[name, level] : instanceLevels)
+		lowest = std::min(lowest, static_cast<int>(level));
+
+	lowestOverride.store(lowest, std::memory_order_relaxed);
+	levelEpoch.fetch_add(1, std::memory_order_acq_rel);
+}
+
+void Logger::SetClassLevel(const std::type_info &type, Level level) {
+	std::unique_lock lock(levelMutex);
+	classLevels.insert_or_assign(ReadableClassName(type), level);
+	LevelsChanged();
+}
+
+void Logger::SetClassLevel(std::string_view className, Level level) {
+	std::unique_lock lock(levelMutex);
+	classLevels.insert_or_assign(ReadableClassName(className), level);
+	LevelsChanged();
+}
+
+void Logger::SetInstanceLevel(std::string_view name, Level level) {
+	std::unique_lock lock(levelMutex);
+	instanceLevels.insert_or_assign(std::string(name), level);
+	LevelsChanged();
+}
+
+void Logger::ClearClassLevel(const std::type_info &type) {
+	ClearClassLevel(ReadableClassName(type));
+}
+
+void Logger::ClearClassLevel(std::string_view className) {
+	std::unique_lock lock(levelMutex);
+	if (auto found = classLevels.find(ReadableClassName(className)); found != classLevels.end())
+		classLevels.erase(found);
+	LevelsChanged();
+}
+
+void Logger::ClearInstanceLevel(std::string_view name) {
+	std::unique_lock lock(levelMutex);
+	if (auto found = instanceLevels.find(name); found != instanceLevels.end())
+		instanceLevels.erase(found);
+	LevelsChanged();
+}
+
+void Logger::ClearLevels() {
+	std::unique_lock lock(levelMutex);
+	classLevels.clear();
+	instanceLevels.clear();
+	LevelsChanged();
+}
+
+std::string Logger::ReadableClassName(const std::type_info &type) {
+	return ReadableClassName(std::string_view(type.name()));
+}
+
+std::string Logger::ReadableClassName(std::string_view name) {
+#ifdef FETCKO_HAS_CXXABI
+	// Anything that isn't a mangled name fails to demangle
+	const std::string mangled(name);
+
+	int status = 0;
+	std::unique_ptr<char, decltype(&std::free)> demangled(abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status), std::free);
+
+	if (status == 0 && demangled)
+		return demangled.get();
+
+	return mangled;
+#else
+	// MSVC's names are readable already, apart from this
+	std::string_view ret(name);
+
+	for (const std::string_view prefix : { "class ", "struct " }) {
+		if (ret.compare(0, prefix.size(), prefix) == 0)
+			ret.remove_prefix(prefix.size());
+	}
+
+	return std::string(ret);
+#endif
+}
+
+namespace {
+// Indexed by Level, plus "off", which no message passes
+constexpr std::array<std::string_view, 5> CommandLevelNames = { "info", "debug", "warning", "error", "off" };
+
+bool SameIgnoringCase(std::string_view a, std::string_view b) {
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](char x, char y) {
+		return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+	});
+}
+
+bool ParseCommandLevel(std::string_view text, Logger::Level &level) {
+	if (Logger::ParseLevel(text, level)) return true;
+	if (!SameIgnoringCase(text, CommandLevelNames.back())) return false;
+
+	level = static_cast<Logger::Level>(CommandLevelNames.size() - 1);
+	return true;
+}
+
+std::string_view LevelName(Logger::Level level) {
+	return CommandLevelNames[std::min<std::size_t>(static_cast<std::size_t>(level), CommandLevelNames.size() - 1)];
+}
+}
+
+bool Logger::ParseLevel(std::string_view name, Level &level) {
+	for (std::size_t i = 0; i < LevelNames.size(); ++i) {
+		if (SameIgnoringCase(name, LevelNames[i])) {
+			level = static_cast<Level>(i);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void Logger::LevelCommand(Arguments arguments) {
+	// loglevel
+	// loglevel <level>
+	// loglevel class <class> <level | reset>
+	// loglevel name <name> <level | reset>
+	std::ostringstream out;
+	Level level;
+
+	if (arguments.size() == 2 && ParseCommandLevel(arguments[1], level)) {
+		logLevel = level;
+	} else if (arguments.size() == 4 && (arguments[1] == "class" || arguments[1] == "name")) {
+		const auto isClass = arguments[1] == "class";
+
+		if (arguments[3] == "reset") {
+			if (isClass) ClearClassLevel(arguments[2]);
+			else ClearInstanceLevel(arguments[2]);
+		} else if (ParseCommandLevel(arguments[3], level)) {
+			if (isClass) SetClassLevel(arguments[2], level);
+			else SetInstanceLevel(arguments[2], level);
+		} else {
+			out << "\rUnknown level " << arguments[3] << '\n';
+		}
+	} else if (arguments.size() != 1) {
+		out << "\rUsage: loglevel [<level> | class <class> <level|reset> | name <name> <level|reset>]\n";
+	}
+
+	out << "\rlogLevel: " << LevelName(logLevel) << '\n';
+
+	{
+		std::shared_lock lock(levelMutex);
+
+		for (const auto &[name, level] : classLevels)
+			out << "  class " << name << ": " << LevelName(level) << '\n';
+
+		for (const auto &[name, level] : instanceLevels)
+			out << "  name " << name << ": " << LevelName(level) << '\n';
+	}
+
+	std::unique_lock lock(mutex);
+	std::cout << out.str();
+	PrintPrompt();
+}
+
+void Logger::PrintPrompt() {
+	if (!hasCommands.load(std::memory_order_relaxed)) return;
+
+#ifdef WIN32
+	SetConsoleTextAttribute(
+		out,
+		static_cast<WORD>(WindowsConsoleColors::Default)
+	);
+#endif
+
+	std::cout << Prompt << std::flush;
+}
+
+void Logger::StartAsync(std::size_t capacity, OverflowPolicy policy) {
+	if (IsAsync()) return;
+
+	StartWriter(capacity, policy);
+}
+
+void Logger::StartDeferred(std::size_t capacity, OverflowPolicy policy, const std::filesystem::path &binaryPath) {
+	if (IsAsync()) return;
+
+	if (!binaryBuffer || binaryBuffer->Capacity() < capacity)
+		binaryBuffer = std::make_unique<MpscRingBuffer<Deferred>>(capacity);
+
+	if (!binaryPath.empty()) {
+		binaryFile.open(binaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+		binaryFile.write(BinaryLog::Magic.data(), BinaryLog::Magic.size());
+		binaryFile.write(reinterpret_cast<const char *>(&BinaryLog::Version), sizeof(BinaryLog::Version));
+	}
+
+	// Calls BinaryLog can't encode still go through the text buffer
+	StartWriter(capacity, policy);
+
+	deferred.store(true, std::memory_order_release);
+}
+
+void Logger::StartWriter(std::size_t capacity, OverflowPolicy policy) {
+	if (!buffer || buffer->Capacity() < capacity)
+		buffer = std::make_unique<MpscRingBuffer<Record>>(capacity);
+
+	overflowPolicy = policy;
+	writerStopping = false;
+
+	ThreadPlacement placement;
+	{
+		std::unique_lock lock(placementMutex);
+		placement = threadPlacement;
+	}
+
+	writerThread = std::thread([placement = std::move(placement)] {
+		if (!placement.IsEmpty())
+			placement.Apply();
+
+		WriterLoop();
+	});
+
+	async.store(true, std::memory_order_release);
+}
+
+void Logger::SetThreadPlacement(ThreadPlacement placement) {
+	std::unique_lock lock(placementMutex);
+	threadPlacement = std::move(placement);
+
+#ifndef WIN32
+	if (readThreadId)
+		threadPlacement.ApplyTo(readThreadId);
+#endif
+}
+
+void Logger::StopAsync() {
+	if (!IsAsync()) return;
+
+	// Anything logged from here on is written synchronously
+	deferred.store(false);
+	async.store(false);
+
+	// Whoever saw async before it was cleared may still be pushing,
+	// or blocked on a full ring, so the writer has to outlive them
+	while (producers.load(std::memory_order_acquire))
+		std::this_thread::yield();
+
+	{
+		std::unique_lock lock(writerMutex);
+		writerStopping = true;
+	}
+	writerWake.notify_one();
+
+	if (writerThread.joinable())
+		writerThread.join();
+
+	// Nothing can be left by now, but it's cheap to be sure.
+	// writerStopping is still set, so this returns once they're empty.
+	WriterLoop();
+
+	if (binaryFile.is_open())
+		binaryFile.close();
+}
+
+void Logger::WriterLoop() {
+	// Records are written in batches of at most this many,
+	// so a flood of messages can't starve the prompt.
+	constexpr std::size_t BatchSize = 256;
+
+	Record record;
+
+	while (true) {
+		std::size_t count = 0;
+		std::size_t printed = 0;
+
+		{
+			auto lock = LockMutex();
+
+			const auto writeBinary = [&](const Deferred &deferred) {
+				const auto &binary = deferred.record;
+
+				if (binaryFile.is_open()) {
+					binaryFile.write(reinterpret_cast<const char *>(&binary.size), sizeof(binary.size));
+					binaryFile.write(binary.data.data(), binary.size);
+
+					messagesWritten[std::min<std::size_t>(BinaryLog::LevelOf(binary), 3)].fetch_add(1, std::memory_order_relaxed);
+					bytesWritten.fetch_add(sizeof(binary.size) + binary.size, std::memory_order_relaxed);
+					return;
+				}
+
+				const auto wanted = formats.load(std::memory_order_relaxed);
+
+				// Counted under it even if no sink wants either format
+				record.level = static_cast<Level>(std::min<std::size_t>(BinaryLog::LevelOf(binary), 3));
+				record.nanoseconds = BinaryLog::TimeOf(binary);
+				record.text.clear();
+				record.json.clear();
+
+				if (wanted & static_cast<unsigned>(Format::Text)) {
+					auto &stream = GetStream();
+					BinaryLog::Format(binary.data.data(), binary.size, stream);
+					record.text = stream.str();
+				}
+
+				if (wanted & static_cast<unsigned>(Format::JsonLines)) {
+					JsonWriter writer(record.json);
+					BinaryLog::FormatJson(binary.data.data(), binary.size, writer);
+				}
+
+				WriteRecord(record);
+				++printed;
+			};
+
+			while (count < BatchSize) {
+				// Never deferred, so there's nothing to merge
+				if (!binaryBuffer) {
+					if (!buffer->TryPop(record)) break;
+
+					WriteRecord(record);
+					++printed;
+					++count;
+					continue;
+				}
+
+				// Every record numbered below this has claimed its slot,
+				// so it's either at a head already or behind one
+				const auto watermark = recordSequence.load(std::memory_order_acquire);
+
+				uint64_t textNext = 0;
+				uint64_t binaryNext = 0;
+
+				const auto hasText = buffer->TryPeekWith([&](const Record &next) { textNext = next.sequence; });
+				const auto hasBinary = binaryBuffer->TryPeekWith([&](const Deferred &next) { binaryNext = next.sequence; });
+
+				// A head that's claimed but not filled in yet could be
+				// numbered lower than anything we can see; wait for it
+				if ((!hasText && buffer->HasClaimed()) || (!hasBinary && binaryBuffer->HasClaimed()))
+					break;
+
+				if (!hasText && !hasBinary) break;
+
+				const auto takeText = hasText && (!hasBinary || textNext < binaryNext);
+
+				// Numbered after we looked; the other ring may have
+				// got one in between, so look again
+				if (const auto next = takeText ? textNext : binaryNext; next != Unnumbered && next >= watermark)
+					continue;
+
+				if (takeText) {
+					buffer->TryPop(record);
+					WriteRecord(record);
+					++printed;
+				} else {
+					binaryBuffer->TryPopWith(writeBinary);
+				}
+
+				++count;
+			}
+
+			// The timer for runs from objects that have gone quiet.
+			// Written here directly; Submit would push to ourselves.
+			if (const auto window = collapseWindow.load(std::memory_order_relaxed);
+				window && oldestRepeat.load(std::memory_order_relaxed) != std::numeric_limits<int64_t>::max()) {
+				for (const auto &run : TakeRepeats(Timestamp::Now() - window)) {
+					WriteRecord(RenderRepeat(run));
+					++printed;
+				}
+			}
+
+			if (const auto drops = dropped.load(std::memory_order_relaxed); drops != droppedReported) {
+				const auto message = "dropped " + std::to_string(drops - droppedReported) + " records";
+
+				const auto now = Timestamp::Now();
+
+				std::string json;
+				JsonWriter writer(json);
+				writer.BeginObject();
+				writer.Field("ts", now);
+				writer.Field("level", LevelNames[static_cast<std::size_t>(Level::Warning)]);
+				writer.Field("class", "Logger");
+				writer.Field("msg", message);
+				writer.EndObject();
+
+				WriteRecord({ Level::Warning, now, "[Warning] Logger: " + message, std::move(json) });
+				droppedReported = drops;
+				++count;
+				++printed;
+			}
+
+			if (count && binaryFile.is_open())
+				binaryFile.flush();
+
+			if (printed)
+				FlushSinks();
+		}
+
+		buffer->PublishConsumed();
+
+		if (binaryBuffer) binaryBuffer->PublishConsumed();
+
+		if (count) continue;
+
+		if (writerStopping) break;
+
+		std::unique_lock lock(writerMutex);
+		writerIdle = true;
+
+		// Producers only notify when we say we're idle, and they
+		// do so without the lock; the timeout covers a missed wakeup.
+		writerWake.wait_for(lock, std::chrono::milliseconds(5), [] { return writerStopping.load(); });
+
+		writerIdle = false;
+	}
 }
 }
\ No newline at end of file
@@ -1,16 +1,37 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <csignal>
 #include <filesystem>
+#include <fstream>
 #include <functional>
 #include <iostream>
 #include <iomanip>
 #include <map>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <shared_mutex>
 #include <sstream>
 #include <string_view>
 #include <thread>
+#include <typeinfo>
+#include <vector>
+
+#include "BinaryLog.hpp"
+#include "FlightRecorder.hpp"
+#include "Hash.hpp"
+#include "LatencyHistogram.hpp"
+#include "Reactor.hpp"
+#include "RingBuffer.hpp"
+#include "Span.hpp"
+#include "StructuredLog.hpp"
+#include "Timestamp.hpp"
+#include "Topology.hpp"
+#include "Tracer.hpp"
 
 #ifdef WIN32
 	#ifndef WIN32_LEAN_AND_MEAN
@@ -25,25 +46,213 @@
 	#undef max
 #endif
 
+// Log calls below this level are compiled out entirely.
+// Set through the UTILS_MIN_LOG_LEVEL CMake option:
+// 0 = Info (keep everything), 1 = Debug, 2 = Warning,
+// 3 = Error, 4 = Off.
+#ifndef FETCKO_MIN_LOG_LEVEL
+	#define FETCKO_MIN_LOG_LEVEL 0
+#endif
+
+// Member functions can't skip evaluating their own arguments,
+// so these wrap a call in a check that happens first. Arguments
+// of a compiled-out level are never evaluated, and arguments of a
+// level filtered at runtime (for that object) aren't either.
+//
+// Use the plain forms inside a LoggableClass (or Logger) member,
+// and the _TO forms with any other LoggableClass or Logger:
+//	FETCKO_LOG_DEBUG("Loaded ", ExpensiveSummary());
+//	FETCKO_LOG_DEBUG_TO(texture, "Loaded ", ExpensiveSummary());
+#define FETCKO_LOG_AT(target, level, method, ...) \
+	do { \
+		if constexpr (::Fetcko::Logger::IsCompiledIn(level)) { \
+			if ((target).IsLevelEnabled(level)) (target).method(__VA_ARGS__); \
+		} \
+	} while (false)
+
+#define FETCKO_LOG_INFO_TO(target, ...) FETCKO_LOG_AT(target, ::Fetcko::Logger::Level::Info, LogInfo, __VA_ARGS__)
+#define FETCKO_LOG_DEBUG_TO(target, ...) FETCKO_LOG_AT(target, ::Fetcko::Logger::Level::Debug, LogDebug, __VA_ARGS__)
+#define FETCKO_LOG_WARNING_TO(target, ...) FETCKO_LOG_AT(target, ::Fetcko::Logger::Level::Warning, LogWarning, __VA_ARGS__)
+#define FETCKO_LOG_ERROR_TO(target, ...) FETCKO_LOG_AT(target, ::Fetcko::Logger::Level::Error, LogError, __VA_ARGS__)
+
+#define FETCKO_LOG_INFO(...) FETCKO_LOG_INFO_TO(*this, __VA_ARGS__)
+#define FETCKO_LOG_DEBUG(...) FETCKO_LOG_DEBUG_TO(*this, __VA_ARGS__)
+#define FETCKO_LOG_WARNING(...) FETCKO_LOG_WARNING_TO(*this, __VA_ARGS__)
+#define FETCKO_LOG_ERROR(...) FETCKO_LOG_ERROR_TO(*this, __VA_ARGS__)
+
 namespace Fetcko {
+// Defers computing an argument until we know the message is going
+// somewhere, for values that are expensive to produce:
+//	LogDebug("State: ", lazy([&] { return DumpState(); }));
+// f is called at most once per message.
+template<typename F>
+struct Lazy {
+	F f;
+};
+
+template<typename F>
+Lazy<std::decay_t<F>> lazy(F &&f) {
+	return { std::forward<F>(f) };
+}
+
+template<typename T>
+struct IsLazy : std::false_type {};
+
+template<typename F>
+struct IsLazy<Lazy<F>> : std::true_type {};
+
 class LoggableClass;
+class LogRateLimiter;
+class LogSink;
 class Logger {
 public:
-	using Command = std::function<void(const std::vector<std::string> &)>;
+	// Arguments are views over the command line, name first.
+	// They're only valid for the duration of the call.
+	using Arguments = Span<const std::string_view>;
+	using Command = std::function<void(Arguments)>;
 
+	// Commands that already exist keep their original handler.
+	// The first call starts the thread reading them from stdin,
+	// unless SetReadThreadEnabled(false) came before it.
 	static void AddCommands(std::map<std::string, Command> &&commands);
+
+	// For programs that read their own input, or have none. Turning
+	// it back on starts the thread if there are commands already.
+	// On Windows, once started, it runs until the process ends.
+	static void SetReadThreadEnabled(bool enabled);
+
+#ifndef WIN32
+	// Elsewhere, reading stdin is one job of the console thread, a
+	// Reactor that also flushes idle sinks every second and drives
+	// "logstats every". It's stopped and joined at exit.
+	//
+	// This returns its Reactor, for anything else that wants a timer
+	// or a descriptor watched without a thread of its own, starting
+	// it if need be (without reading stdin, unless commands do).
+	// Null if epoll isn't available.
+	static Reactor *GetReactor();
+
+	// Done at exit anyway. Commands aren't read after this.
+	static void StopConsole();
+
+	// Has the console thread call the OnClose function when one of
+	// signals arrives, as closing the console does on Windows. With
+	// no OnClose, the signal does what it would have. They're blocked
+	// in the calling thread and need to be in every thread, so call
+	// this at the top of main, before starting any others.
+	static bool HandleCloseSignals(std::vector<int> signals = { SIGINT, SIGTERM, SIGHUP });
+#endif
+
+	// Queues line as if it had been typed, to run on the next
+	// ProcessCommands. False if it doesn't name a command.
+	static bool QueueCommand(std::string_view line);
+
+	// Runs everything queued by the read thread. The queue is swapped
+	// out under its own short lock and the commands run with no lock
+	// held, so they can log (or take as long as they like) without
+	// stalling anyone else's logging.
 	static void ProcessCommands();
 
+	// Nanosecond totals and maximums since startup.
+	// Wait is time spent queued, run is time spent executing.
+	struct CommandStats {
+		uint64_t executed = 0;
+		uint64_t pending = 0;
+		uint64_t totalWait = 0;
+		uint64_t maxWait = 0;
+		uint64_t totalRun = 0;
+		uint64_t maxRun = 0;
+	};
+
+	static CommandStats GetCommandStats();
+
 private:
-	static std::thread StartReadThread();
-	static std::thread readThread;
-	static std::map<std::string, Command> commands;
-	static std::queue<std::pair<Command, std::vector<std::string>>> commandQueue;
+	// Open addressing over FNV-1a hashes of the command names,
+	// so dispatching a line never allocates or walks a tree
+	class CommandTable {
+	public:
+		// Returns false if name is already taken
+		bool Insert(std::string &&name, Command &&command);
+		const std::shared_ptr<const Command> *Find(std::string_view name) const;
+
+		bool Empty() const { return count == 0; }
+
+	private:
+		struct Entry {
+			uint32_t hash = 0;
+			std::string name;
+			std::shared_ptr<const Command> command;
+		};
+
+		void Grow();
+
+		std::vector<Entry> entries;
+		std::size_t count = 0;
+	};
+
+	struct QueuedCommand {
+		// Shared so queueing is a refcount, not a copy of the function
+		std::shared_ptr<const Command> command;
+
+		// Re-tokenized when it runs; views into it wouldn't
+		// survive the queue moving it around
+		std::string line;
+
+		std::chrono::steady_clock::time_point queued;
+	};
+
+	static void StartReadThread();
+
+	// Both guarded by commandMutex
+	static bool readThreadStarted;
+	static bool readThreadEnabled;
+
+#ifndef WIN32
+	// Guarded by commandMutex. Set once, and never freed
+	// until after the thread has been joined.
+	static std::unique_ptr<Reactor> console;
+	static std::thread consoleThread;
+
+	// The "logstats every" timer, or -1.
+	// Only touched by that command.
+	static int statsTimer;
+
+	static void StartConsole();
+
+	// Console thread only. False at the end of input.
+	static bool ReadConsoleInput();
+	static void OnConsoleTimer();
+	static void OnCloseSignal(int signal);
+#endif
+
+	// Guarded by placementMutex
+	static std::mutex placementMutex;
+	static ThreadPlacement threadPlacement;
+#ifndef WIN32
+	static pid_t readThreadId;
+#endif
+
+	// All guarded by commandMutex, never by mutex
+	static CommandTable commands;
+	static std::vector<QueuedCommand> commandQueue;
+
+	// Lines that have run, kept for QueueCommand to copy the
+	// next ones into, so queueing doesn't allocate either
+	static std::vector<std::string> spareLines;
+
+	static std::mutex commandMutex;
+	static std::atomic<bool> hasCommands;
+
+	static std::atomic<uint64_t> commandsExecuted;
+	static std::atomic<uint64_t> commandsPending;
+	static std::atomic<uint64_t> commandWaitTotal;
+	static std::atomic<uint64_t> commandWaitMax;
+	static std::atomic<uint64_t> commandRunTotal;
+	static std::atomic<uint64_t> commandRunMax;
 
 	static std::mutex mutex;
-	static std::atomic<bool> processingCommands;
 
-	static std::size_t maxClassNameWidth;
+	static std::atomic<std::size_t> maxClassNameWidth;
 
 public:
 	enum class Level {
@@ -53,154 +262,736 @@ public:
 		Error
 	};
 
+	// What a producer does when the async buffer is full
+	enum class OverflowPolicy {
+		Block,			// Spin until the writer frees a slot
+		Drop,			// Throw the record away
+		DropAndCount	// Throw it away, but remember how many we lost
+	};
+
+	// What a sink wants each message rendered as. Messages are only
+	// rendered in the formats at least one attached sink asks for.
+	enum class Format {
+		Text = 1,		// The usual "[ Debug ] (...) Class [0x...]: message"
+		JsonLines = 2	// One JSON object per line, kv() arguments as fields
+	};
+
 	static Level logLevel;
 
-	void SetObject(LoggableClass *object);
-	void SetLogLevel(Level logLevel) { this->logLevel = logLevel; }
+	static constexpr Level MinLevel = static_cast<Level>(FETCKO_MIN_LOG_LEVEL);
 
-	template<typename T, typename... Args>
-	void LogInfo(T t, Args... args) const {
-		std::unique_lock lock(mutex, std::defer_lock);
+	static constexpr bool IsCompiledIn(Level level) { return level >= MinLevel; }
 
-		if (!processingCommands) lock.lock();
+	// Whether a call at level could do anything for some object: it
+	// passes logLevel or an override, or the flight recorder wants it.
+	// IsLevelEnabled gives the answer for one particular object.
+	static bool IsEnabled(Level level) {
+		return IsCompiledIn(level) && (
+			level >= logLevel ||
+			static_cast<int>(level) >= lowestOverride.load(std::memory_order_relaxed) ||
+			IsRecorded(level)
+		);
+	}
 
-		Log(Level::Info, t, args...);
-		PrintPrompt(Level::Info);
+	static bool IsRecorded(Level level) {
+		return static_cast<int>(level) >= recorderLevel.load(std::memory_order_acquire);
 	}
 
-	template<typename T, typename... Args>
-	void LogDebug(T t, Args... args) const {
-		std::unique_lock lock(mutex, std::defer_lock);
+	// Instead of writing on the calling thread, hand pre-formatted
+	// records to a background writer which drains them in batches.
+	static void StartAsync(std::size_t capacity = 8192, OverflowPolicy policy = OverflowPolicy::Block);
+
+	// Like StartAsync, but calls whose arguments BinaryLog can encode
+	// skip formatting entirely and only copy raw bytes. Those records
+	// are formatted by the writer, or appended to binaryPath (if given)
+	// for offline decoding with BinaryLog::Decode. Calls too big for a
+	// BinaryLog::Record are formatted as usual rather than cut short.
+	static void StartDeferred(
+		std::size_t capacity = 4096,
+		OverflowPolicy policy = OverflowPolicy::Block,
+		const std::filesystem::path &binaryPath = {}
+	);
+
+	// Waits for threads already pushing, drains anything
+	// still buffered, then joins the writer
+	static void StopAsync();
+
+	// Where the writer and read threads run, to keep them off the
+	// cores doing real work. The writer picks it up from its next
+	// StartAsync or StartDeferred. On Linux, the read thread is moved
+	// straight away, but keeps its memory policy.
+	static void SetThreadPlacement(ThreadPlacement placement);
+
+	// Every message that passes logLevel goes to each sink whose own
+	// level it passes too. A ConsoleSink is attached to start with.
+	static void AddSink(std::shared_ptr<LogSink> sink);
+	static void RemoveSink(const std::shared_ptr<LogSink> &sink);
+	static void ClearSinks();
+
+	static bool IsAsync() { return async.load(std::memory_order_acquire); }
+	static bool IsDeferred() { return deferred.load(std::memory_order_acquire); }
+	static std::size_t GetDroppedCount() { return dropped.load(std::memory_order_relaxed); }
+
+	// What logging has cost so far. Also printed by the
+	// "logstats" console command once any commands exist.
+	struct Stats {
+		// Records handed to the sinks (or the binary file), by Level
+		std::array<uint64_t, 4> messages {};
+
+		// Bytes handed to the sinks, newlines included
+		uint64_t bytes = 0;
+
+		// Waiting on mutex, in nanoseconds. Only
+		// acquisitions that found it taken are timed.
+		uint64_t lockContended = 0;
+		uint64_t lockWaitTotal = 0;
+		uint64_t lockWaitMax = 0;
+
+		// Repeats swallowed by SetCollapseWindow, not counted in messages
+		uint64_t collapsed = 0;
+
+		// Async only. Dropped isn't cleared by ResetStats.
+		uint64_t dropped = 0;
+		std::size_t backlog = 0;
+		std::size_t capacity = 0;
+
+		// Nanoseconds from entering Log to having handed the
+		// record off, if latency tracking is on. As precise
+		// as the Timestamp source.
+		LatencyHistogram::Snapshot latency;
+	};
+
+	static Stats GetStats();
+	static void ResetStats();
+
+	// Override logLevel for every object of a class, or every object
+	// with a given name. A name beats a class, and an object's own
+	// SetLogLevel beats both. Classes are matched by typeid, or by
+	// name either as typeid gives it or demangled ("Fetcko::Utils").
+	// Also available as the "loglevel" console command.
+	static void SetClassLevel(const std::type_info &type, Level level);
+	static void SetClassLevel(std::string_view className, Level level);
+	static void SetInstanceLevel(std::string_view name, Level level);
+
+	static void ClearClassLevel(const std::type_info &type);
+	static void ClearClassLevel(std::string_view className);
+	static void ClearInstanceLevel(std::string_view name);
+	static void ClearLevels();
+
+	// "info", "debug", "warning" or "error", in any case, as
+	// Format::JsonLines writes them and the commands take them
+	static bool ParseLevel(std::string_view name, Level &level);
+
+	// Keeps the last capacity records at or above level in memory,
+	// whether or not they pass logLevel, ready to be written to
+	// dumpPath by a crash (with handleSignals) or the "flightdump"
+	// command. Read dumps with BinaryLog::Decode.
+	// Only the first call allocates; later ones just change the level.
+	static void StartFlightRecorder(
+		const std::filesystem::path &dumpPath,
+		Level level = Level::Info,
+		std::size_t capacity = 8192,
+		bool handleSignals = true
+	);
+
+	// What's been recorded is kept until the next start
+	static void StopFlightRecorder();
+
+	// An empty path means the one given to StartFlightRecorder
+	static bool DumpFlightRecorder(const std::filesystem::path &path = {});
 
-		if (!processingCommands) lock.lock();
+	// Costs one extra Timestamp::Now per message, so it's off to start with
+	static void SetLatencyTracking(bool enabled) { trackLatency.store(enabled, std::memory_order_relaxed); }
+	static bool IsTrackingLatency() { return trackLatency.load(std::memory_order_relaxed); }
 
-		Log(Level::Debug, t, args...);
-		PrintPrompt(Level::Debug);
+	// Collapses a run of the same message from the same object into
+	// the first one and a "Last message repeated N times" line, which
+	// is written once the object logs something else, or the run has
+	// gone on for window. Messages are compared by a hash of their
+	// level and arguments, so repeats are never formatted. The flight
+	// recorder still gets every one. Zero (the default) turns it off.
+	static void SetCollapseWindow(std::chrono::milliseconds window);
+	static std::chrono::milliseconds GetCollapseWindow() {
+		return std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::nanoseconds(collapseWindow.load(std::memory_order_relaxed))
+		);
+	}
+
+	// Writes out every run still being counted, however young,
+	// and every FETCKO_LOG_PER_SECOND burst not yet summarized
+	static void FlushRepeats();
+
+	// For FETCKO_LOG_PER_SECOND: limiter has started holding back
+	// messages to this object, so if the site goes quiet before it
+	// can report them, the summary still has somewhere to go
+	void HoldSuppressed(LogRateLimiter &limiter, Level level) const;
+
+	Logger() = default;
+
+	// The cached header belongs to the object, not the
+	// logger, so copies start with a fresh one.
+	Logger(const Logger &other) : object(other.object) {}
+	Logger &operator=(const Logger &other) {
+		object = other.object;
+		RefreshHeader();
+		return *this;
 	}
 
+	~Logger() {
+		auto *state = this->state.load(std::memory_order_acquire);
+		if (!state) return;
+
+		if (state->lastMessage.load(std::memory_order_relaxed) & Repeating)
+			EndRepeat();
+
+		delete state;
+	}
+
+	// Just remembers the object. Inside its constructor typeid
+	// would only see the base class anyway, so everything else
+	// waits until it first logs.
+	void SetObject(LoggableClass *object) { this->object = object; }
+
+	// The object's class, name and address are formatted once,
+	// on the first message, and reused from then on. Call this
+	// if the name changes so the next message picks it up.
+	void RefreshHeader() {
+		auto *state = this->state.load(std::memory_order_acquire);
+		if (!state) return;
+
+		state->header.fetch_or(Stale, std::memory_order_release);
+
+		// A new name may match a different override
+		state->levels.fetch_and(~(EpochMask << EpochShift), std::memory_order_release);
+	}
+
+	// Only this object. Set logLevel itself to change everyone's.
+	void SetLogLevel(Level level) { SetOwnLevel(static_cast<uint64_t>(level)); }
+	void ResetLogLevel() { SetOwnLevel(NoOverride); }
+
+	// The lowest level this object logs at. The cached answer is kept
+	// with the epoch it was worked out in, so unless an override has
+	// changed since (or typeid changed its mind about the class),
+	// this is a few loads and compares. Defined below LoggableClass.
+	Level GetThreshold() const;
+
+	bool IsLevelEnabled(Level level) const {
+		return IsCompiledIn(level) && (level >= GetThreshold() || IsRecorded(level));
+	}
+
+	// Arguments are only ever read, so they're taken by
+	// reference all the way down and never copied.
 	template<typename T, typename... Args>
-	void LogWarning(T t, Args... args) const {
-		std::unique_lock lock(mutex, std::defer_lock);
+	void Log(Level level, const T &t, const Args &... args) const {
+		if (!IsLevelEnabled(level)) return;
 
-		if (!processingCommands) lock.lock();
+		if constexpr (IsLazy<T>::value || (IsLazy<Args>::value || ...))
+			Emit(level, Evaluate(t), Evaluate(args)...);
+		else
+			Emit(level, t, args...);
+	}
 
-		Log(Level::Warning, t, args...);
-		PrintPrompt(Level::Warning);
+	template<typename T, typename... Args>
+	void LogInfo(const T &t, const Args &... args) const {
+		if constexpr (IsCompiledIn(Level::Info))
+			Log(Level::Info, t, args...);
 	}
 
 	template<typename T, typename... Args>
-	void LogError(T t, Args... args) const {
-		std::unique_lock lock(mutex, std::defer_lock);
+	void LogDebug(const T &t, const Args &... args) const {
+		if constexpr (IsCompiledIn(Level::Debug))
+			Log(Level::Debug, t, args...);
+	}
 
-		if (!processingCommands) lock.lock();
+	template<typename T, typename... Args>
+	void LogWarning(const T &t, const Args &... args) const {
+		if constexpr (IsCompiledIn(Level::Warning))
+			Log(Level::Warning, t, args...);
+	}
 
-		Log(Level::Error, t, args...);
-		PrintPrompt(Level::Error);
+	template<typename T, typename... Args>
+	void LogError(const T &t, const Args &... args) const {
+		if constexpr (IsCompiledIn(Level::Error))
+			Log(Level::Error, t, args...);
 	}
 
 	static void SetOnClose(std::function<void()> &&f) { onClose = f; }
 	static const std::function<void()> &GetOnClose() { return onClose; }
 
+	// Shared by WriteHeader and BinaryLog so that deferred
+	// records come out looking exactly like synchronous ones
+	static void FormatHeader(
+		std::ostream &out,
+		Level level,
+		int64_t nanoseconds,
+		std::string_view className,
+		std::string_view name,
+		const void *address
+	);
+
+	// The same for Format::JsonLines. Writes the fields only,
+	// so the caller can add its own before closing the object.
+	static void FormatJsonHeader(
+		JsonWriter &out,
+		Level level,
+		int64_t nanoseconds,
+		std::string_view className,
+		std::string_view name,
+		const void *address
+	);
+
 	static void OnDestroy() {
+#ifndef WIN32
+		StopConsole();
+#endif
+		FlushRepeats();
+		StopAsync();
+
 #ifdef WIN32
 		FreeConsole();
 #endif
 	}
 
 private:
+	struct Record {
+		Level level = Level::Info;
+		int64_t nanoseconds = 0;
+
+		// Either may be empty if no sink wants that format
+		std::string text;
+		std::string json;
+
+		// While deferred, from recordSequence, otherwise Unnumbered; see Deferred
+		uint64_t sequence = 0;
+	};
+
+	// Messages are formatted into a per-thread stream
+	// so that the lock (or the ring buffer) only ever
+	// sees a finished line.
+	static std::ostringstream &GetStream() {
+		thread_local std::ostringstream stream;
+		stream.str({});
+		stream.clear();
+		return stream;
+	}
+
 	template <typename T>
-	void Log(T t) const {
-		std::cout << t;
+	static void Append(std::ostream &out, const T &t) {
+		if constexpr (std::is_same<T, std::filesystem::path>::value)
+			out << t.u8string();
+		else
+			out << t;
 	}
 
-	template<>
-	void Log<std::filesystem::path>(std::filesystem::path t) const {
-		std::cout << t.u8string();
+	template<typename T, typename... Args>
+	static void Append(std::ostream &out, const T &t, const Args &... args) {
+		Append(out, t);
+		Append(out, args...);
+	}
+
+	// Append, skipping kv() arguments
+	template<typename... Args>
+	static void AppendMessage(std::ostream &out, const Args &... args) {
+		([&](const auto &arg) {
+			if constexpr (!IsKeyValue<std::decay_t<decltype(arg)>>::value)
+				Append(out, arg);
+		}(args), ...);
+	}
+
+	// Only kv() arguments, as fields of their own
+	template<typename... Args>
+	static void AppendFields(JsonWriter &out, const Args &... args) {
+		([&](const auto &arg) {
+			if constexpr (IsKeyValue<std::decay_t<decltype(arg)>>::value)
+				out.Field(arg.key, arg.value);
+		}(args), ...);
+	}
+
+	// Everything in a message header after the timestamp:
+	// "<class><padding> (<name>) [0x<address>]: "
+	struct Header {
+		std::string text;
+		std::size_t classNameLength = 0;
+
+		// What text was padded to. If a wider class has
+		// registered since, we pad the difference on write.
+		std::size_t width = 0;
+
+		// Replaced headers stay alive as long as the logger,
+		// since another thread may still be writing one out.
+		std::unique_ptr<Header> previous;
+	};
+
+	const Header &GetHeader() const;
+	Header BuildHeader() const;
+
+	// State::header holds a Header *, with its low bit set once it's stale
+	static constexpr uintptr_t Stale = 1;
+	static Header *ToHeader(uintptr_t bits) { return reinterpret_cast<Header *>(bits & ~Stale); }
+
+	// The first time a class logs, its name is measured and its
+	// width registered. After that it's one lookup by type_info.
+	static std::string_view InternClassName(const std::type_info &type);
+
+	void WriteHeader(std::ostream &out, Level level, int64_t nanoseconds) const;
+	static void WriteAddress(std::ostream &out, const void *address);
+
+	// "0x" and lowercase hex. out needs room for AddressLength chars.
+	static constexpr std::size_t AddressLength = 2 + 2 * sizeof(uintptr_t);
+	static std::string_view FormatAddress(const void *address, char *out);
+
+	std::string_view GetClassName() const;
+	const std::string &GetObjectName() const;
+
+	// Lazy arguments are called here, once
+	template<typename T>
+	static decltype(auto) Evaluate(const T &t) {
+		if constexpr (IsLazy<T>::value)
+			return t.f();
+		else
+			return (t);
 	}
 
 	template<typename T, typename... Args>
-	void Log(Level level, T t, Args... args) const {
-		if (level >= logLevel) {
-			Log(level, t);
-			Log(args...);
+	void Emit(Level level, const T &t, const Args &... args) const {
+		// The recorder, the sinks and both formats share one timestamp
+		const auto nanoseconds = Timestamp::Now();
+
+		if (IsRecorded(level))
+			RecordFlight(level, nanoseconds, t, args...);
+
+		if (level < GetThreshold()) return;
+
+		if (const auto window = collapseWindow.load(std::memory_order_relaxed); window) {
+			if (IsRepeat(nanoseconds, window, level, HashMessage(level, t, args...))) {
+				RecordLatency(nanoseconds);
+				return;
+			}
+		}
+
+		if constexpr (BinaryLog::AllEncodable<T, Args...>) {
+			if (IsDeferred() && SubmitDeferred(level, nanoseconds, t, args...)) {
+				RecordLatency(nanoseconds);
+				return;
+			}
+		}
+
+		const auto wanted = formats.load(std::memory_order_relaxed);
+		if (!wanted) return;
+
+		std::string text;
+		std::string json;
+
+		if (wanted & static_cast<unsigned>(Format::Text)) {
+			auto &stream = GetStream();
+
+			WriteHeader(stream, level, nanoseconds);
+			Append(stream, t, args...);
+
+			text = stream.str();
 		}
+
+		if (wanted & static_cast<unsigned>(Format::JsonLines)) {
+			JsonWriter writer(json);
+			writer.BeginObject();
+			FormatJsonHeader(writer, level, nanoseconds, GetClassName(), GetObjectName(), object);
+
+			// Everything that isn't a kv() is the message
+			auto &stream = GetStream();
+			AppendMessage(stream, t, args...);
+			writer.Field("msg", stream.str());
+
+			AppendFields(writer, t, args...);
+			writer.EndObject();
+		}
+
+		Submit(level, nanoseconds, std::move(text), std::move(json));
+		RecordLatency(nanoseconds);
 	}
 
+	// A run of repeats from one object that hasn't been written yet
+	struct Repeat {
+		Level level = Level::Info;
+		uint64_t count = 0;
+
+		// When the first and last repeats were logged
+		int64_t first = 0;
+		int64_t last = 0;
+
+		// Copied when the run starts, since the
+		// object may be gone by the time it's written
+		std::string_view className;
+		std::string name;
+		const void *address = nullptr;
+	};
+
+	// Strings and numbers are hashed as they are. Anything
+	// else has to be formatted before it can be compared.
 	template<typename T>
-	void Log(Level level, T t) const {
-		if (level >= logLevel) {
-#ifdef WIN32
-			SetConsoleTextAttribute(
-				out,
-				static_cast<WORD>(Colors.at(level))
-			);
-#endif
+	static uint64_t HashArgument(uint64_t hash, const T &t) {
+		if constexpr (IsKeyValue<T>::value) {
+			return HashArgument(HashArgument(hash, t.key), t.value);
+		} else if constexpr (std::is_same<T, std::filesystem::path>::value) {
+			const auto &native = t.native();
+			return hash_64_fnv1a_const(reinterpret_cast<const char *>(native.data()), native.size() * sizeof(native[0]), hash);
+		} else if constexpr (std::is_convertible<const T &, std::string_view>::value) {
+			const std::string_view string(t);
+			return hash_64_fnv1a_const(string.data(), string.size(), hash);
+		} else if constexpr (std::is_arithmetic<T>::value) {
+			return hash_64_fnv1a_const(reinterpret_cast<const char *>(&t), sizeof(t), hash);
+		} else {
+			auto &stream = GetStream();
+			Append(stream, t);
+			const auto text = stream.str();
+			return hash_64_fnv1a_const(text.data(), text.size(), hash);
+		}
+	}
+
+	// Seeded with collapseEpoch, so nothing counts as a repeat
+	// of what was logged before the window last changed
+	template<typename... Args>
+	static uint64_t HashMessage(Level level, const Args &... args) {
+		const auto epoch = collapseEpoch.load(std::memory_order_relaxed);
 
-			const auto time = std::chrono::system_clock::to_time_t(
-				std::chrono::system_clock::now()
+		auto hash = hash_64_fnv1a_const(reinterpret_cast<const char *>(&epoch), sizeof(epoch));
+		hash = hash_64_fnv1a_const(reinterpret_cast<const char *>(&level), sizeof(level), hash);
+		((hash = HashArgument(hash, args)), ...);
+
+		return hash;
+	}
+
+	// True if the message was the same as this object's last one,
+	// and so was counted instead of written
+	bool IsRepeat(int64_t nanoseconds, int64_t window, Level level, uint64_t hash) const;
+
+	// Writes out this object's run, if it has one
+	void EndRepeat() const;
+
+	// Takes every run that started at or before cutoff out of
+	// repeats, oldest last repeat first
+	static std::vector<Repeat> TakeRepeats(int64_t cutoff);
+	static void FlushRepeats(int64_t cutoff);
+	static Record RenderRepeat(const Repeat &repeat);
+
+	// Summarizes the bursts of every limiter whose window started
+	// before second (in Timestamp seconds)
+	static void FlushSuppressed(int64_t second);
+
+	// A line under the run's header, with count under key in JSON
+	static Record RenderNote(const Repeat &run, std::string_view message, std::string_view key);
+
+	static void RecordLatency(int64_t start) {
+		if (trackLatency.load(std::memory_order_relaxed))
+			latency.Record(static_cast<uint64_t>(std::max<int64_t>(Timestamp::Now() - start, 0)));
+	}
+
+	// False if the record would be too big, so it
+	// goes down the text path instead of being cut short
+	template<typename... Args>
+	bool SubmitDeferred(Level level, int64_t nanoseconds, const Args &... args) const {
+		const auto className = GetClassName();
+		const auto &name = GetObjectName();
+
+		if (BinaryLog::EncodedSize(className, name, args...) > BinaryLog::MaxRecordSize)
+			return false;
+
+		// StopAsync may have started since the caller looked
+		Producing producing;
+		if (!deferred.load()) return false;
+
+		Push(*binaryBuffer, [&](Deferred &deferred) {
+			deferred.sequence = recordSequence.fetch_add(1, std::memory_order_release);
+
+			BinaryLog::Encode(
+				deferred.record,
+				nanoseconds,
+				static_cast<uint8_t>(level),
+				object,
+				className,
+				name,
+				args...
 			);
+		});
 
-			const auto &name = object->GetName();
-
-			std::cout
-				<< "\r["
-				<< Labels.at(level)
-				<< "] ("
-				<< std::put_time(std::localtime(&time), "%d%b%Y %H:%M:%S")
-				<< ") "
-				<< std::setw(maxClassNameWidth)
-				<< std::left
-				<< std::setfill(' ')
-				<< typeid(*object).name();
-
-			if (name.size()) {
-				std::cout
-					<< " ("
-					<< name
-					<< ")";
-			}
+		return true;
+	}
 
-			std::stringstream addressStream;
-			addressStream << std::hex << object;
-			auto address = addressStream.str();
-			address.erase(0, address.find_first_not_of('0'));
-
-			std::cout
-				<< " [0x"
-				<< std::hex
-				<< address
-				<< std::dec
-				<< "]: "
-				<< t;
+	template<typename... Args>
+	void RecordFlight(Level level, int64_t nanoseconds, const Args &... args) const {
+		const auto className = GetClassName();
+		const auto &name = GetObjectName();
+
+		if constexpr (BinaryLog::AllEncodable<Args...>) {
+			flightRecorder->Push([&](BinaryLog::Record &record) {
+				BinaryLog::Encode(record, nanoseconds, static_cast<uint8_t>(level), object, className, name, args...);
+			});
+		} else {
+			// Whatever BinaryLog can't encode is kept as one formatted string
+			auto &stream = GetStream();
+			Append(stream, args...);
+			const auto message = stream.str();
+
+			flightRecorder->Push([&](BinaryLog::Record &record) {
+				BinaryLog::Encode(record, nanoseconds, static_cast<uint8_t>(level), object, className, name, std::string_view(message));
+			});
 		}
 	}
 
-	template<typename T, typename... Args>
-	void Log(T t, Args... args) const {
-		if constexpr (std::is_same<T, std::filesystem::path>::value)
-			std::cout << t.u8string();
-		else
-			std::cout << t;
+	// Applies the overflow policy while f fills a slot
+	template<typename R, typename F>
+	static void Push(MpscRingBuffer<R> &ring, F &&f) {
+		while (!ring.TryPushWith(f)) {
+			if (overflowPolicy == OverflowPolicy::Block) {
+				writerWake.notify_one();
+				std::this_thread::yield();
+				continue;
+			}
 
-		Log(args...);
+			if (overflowPolicy == OverflowPolicy::DropAndCount)
+				dropped.fetch_add(1, std::memory_order_relaxed);
+
+			return;
+		}
+
+		// Only the first producer to find the writer asleep pays for the wakeup
+		if (writerIdle.load(std::memory_order_relaxed) && writerIdle.exchange(false))
+			writerWake.notify_one();
 	}
 
-	void PrintPrompt(Level level) const {
-		if (level < logLevel) return;
+	static void StartWriter(std::size_t capacity, OverflowPolicy policy);
+	static void Submit(Level level, int64_t nanoseconds, std::string &&text, std::string &&json);
+	static void WriteRecord(const Record &record);
+	static void FlushSinks();
+	static void PrintPrompt();
 
-		std::cout << std::endl;
+	// Guarded by mutex
+	static void UpdateFormats();
 
-		if (commands.empty()) return;
+	// Locks mutex, timing the wait if someone else has it
+	static std::unique_lock<std::mutex> LockMutex();
 
-#ifdef WIN32
-		SetConsoleTextAttribute(
-			out,
-			static_cast<WORD>(WindowsConsoleColors::Default)
-		);
-#endif
+	static void PrintStats(Arguments arguments);
 
-		std::cout << " > ";
-	}
+	// Only written with mutex held, so they never contend
+	static std::array<std::atomic<uint64_t>, 4> messagesWritten;
+	static std::atomic<uint64_t> bytesWritten;
+
+	static std::atomic<uint64_t> lockContended;
+	static std::atomic<uint64_t> lockWaitTotal;
+	static std::atomic<uint64_t> lockWaitMax;
+
+	static std::atomic<bool> trackLatency;
+	static LatencyHistogram latency;
+
+	// In nanoseconds, or 0 when collapsing is off
+	static std::atomic<int64_t> collapseWindow;
+	static std::atomic<uint64_t> collapseEpoch;
+	static std::atomic<uint64_t> messagesCollapsed;
+
+	// Keyed by the Logger whose run it is. Guarded by repeatMutex,
+	// which is never held while taking mutex.
+	static std::mutex repeatMutex;
+	static std::map<const Logger *, Repeat> repeats;
+
+	// Where each limiter's held back burst gets summarized, taken
+	// from the last object it held one back from. Also guarded by
+	// repeatMutex. Limiters are statics, so entries are never removed.
+	static std::map<LogRateLimiter *, Repeat> suppressedSites;
+
+	// When the oldest run in repeats started, or INT64_MAX,
+	// so the timer check is one load while nothing repeats
+	static std::atomic<int64_t> oldestRepeat;
+
+	// Never freed, since producers and the signal
+	// handlers may be using it right up until exit
+	static FlightRecorder *flightRecorder;
+
+	// The lowest Level recorded, or NotRecorded
+	static constexpr int NotRecorded = 4;
+	static std::atomic<int> recorderLevel;
+
+	// levels packs, from the top: the epoch the threshold was worked
+	// out in, the object's own level, and the threshold itself. Both
+	// levels are NoOverride if unset, and a threshold of NoOverride
+	// means logLevel, which can change without bumping the epoch.
+	static constexpr uint64_t LevelMask = 0xFF;
+	static constexpr uint64_t NoOverride = LevelMask;
+	static constexpr int OwnShift = 8;
+	static constexpr int EpochShift = 16;
+	static constexpr uint64_t EpochMask = UINT64_MAX >> EpochShift;
+
+	Level RefreshThreshold() const;
+	void SetOwnLevel(uint64_t level);
+
+	// Bumps levelEpoch so every object works its threshold out again
+	static void LevelsChanged();
+
+	// classLevels is keyed by these, so both spellings of a
+	// class end up at the same entry. Readable names come back
+	// as they are.
+	static std::string ReadableClassName(const std::type_info &type);
+	static std::string ReadableClassName(std::string_view name);
+	static void LevelCommand(Arguments arguments);
+
+	// Starts at 1, so a fresh object's epoch of 0 is always stale
+	static std::atomic<uint64_t> levelEpoch;
+
+	// The lowest level any override or SetLogLevel has asked for,
+	// for the static IsEnabled. Never raised by SetLogLevel.
+	static std::atomic<int> lowestOverride;
+	static std::atomic<int> lowestOwnLevel;
+
+	// Guarded by levelMutex
+	static std::shared_mutex levelMutex;
+	static std::map<std::string, Level, std::less<>> classLevels;
+	static std::map<std::string, Level, std::less<>> instanceLevels;
+
+	static std::vector<std::shared_ptr<LogSink>> sinks;
+
+	// Format bits wanted by at least one sink
+	static std::atomic<unsigned> formats;
+	static void WriterLoop();
+
+	static std::atomic<bool> async;
+	static std::unique_ptr<MpscRingBuffer<Record>> buffer;
+
+	// While deferred, a thread's messages may go to either ring. Each
+	// record takes a number from recordSequence once it has its slot.
+	// The writer only writes a head numbered below what recordSequence
+	// said beforehand, and never while the other ring's head is claimed
+	// but unfinished, so records come out in the order they were
+	// numbered: each thread's in the order it logged them. Text records
+	// logged while not deferred are Unnumbered, and go after the rest.
+	struct Deferred {
+		uint64_t sequence = 0;
+		BinaryLog::Record record;
+	};
+
+	static std::atomic<bool> deferred;
+	static std::unique_ptr<MpscRingBuffer<Deferred>> binaryBuffer;
+	static std::atomic<uint64_t> recordSequence;
+	static constexpr uint64_t Unnumbered = UINT64_MAX;
+	static std::ofstream binaryFile;
+
+	static OverflowPolicy overflowPolicy;
+	static std::atomic<std::size_t> dropped;
+	static std::size_t droppedReported;
+
+	// Held by a producer from just before it checks async (or deferred)
+	// until it's done with the ring, so StopAsync can wait for anyone
+	// who got in before it, and the rings are never replaced under them.
+	struct Producing {
+		Producing() { producers.fetch_add(1); }
+		~Producing() { producers.fetch_sub(1, std::memory_order_release); }
+	};
+
+	static std::atomic<unsigned> producers;
+
+	static std::thread writerThread;
+	static std::mutex writerMutex;
+	static std::condition_variable writerWake;
+	static std::atomic<bool> writerIdle;
+	static std::atomic<bool> writerStopping;
 
 #ifdef WIN32
 	enum class WindowsConsoleColors {
@@ -222,25 +1013,77 @@ private:
 		White
 	};
 
-	static inline const std::map<Level, WindowsConsoleColors> Colors = {
-		{ Level::Info, WindowsConsoleColors::DarkCyan },
-		{ Level::Debug, WindowsConsoleColors::DarkGreen },
-		{ Level::Warning, WindowsConsoleColors::DarkYellow },
-		{ Level::Error, WindowsConsoleColors::DarkRed }
+	// Indexed by Level
+	static constexpr std::array<WindowsConsoleColors, 4> Colors = {
+		WindowsConsoleColors::DarkCyan,
+		WindowsConsoleColors::DarkGreen,
+		WindowsConsoleColors::DarkYellow,
+		WindowsConsoleColors::DarkRed
 	};
 
 	static inline const HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+#else
+	// The same colors as ANSI escapes, indexed by Level
+	static constexpr std::array<std::string_view, 4> Colors = {
+		"\x1b[36m",
+		"\x1b[32m",
+		"\x1b[33m",
+		"\x1b[31m"
+	};
+
+	static constexpr std::string_view DefaultColor = "\x1b[0m";
 #endif
 
-	static inline const std::map<Level, std::string_view> Labels = {
-		{ Level::Info,		" Info  " },
-		{ Level::Debug,		" Debug " },
-		{ Level::Warning,	"Warning" },
-		{ Level::Error,		" Error " }
+	static constexpr std::string_view Prompt = " > ";
+
+	// Indexed by Level, already wrapped in "[...] ("
+	static constexpr std::array<std::string_view, 4> Labels = {
+		"[ Info  ] (",
+		"[ Debug ] (",
+		"[Warning] (",
+		"[ Error ] ("
+	};
+
+	// Indexed by Level, for Format::JsonLines
+	static constexpr std::array<std::string_view, 4> LevelNames = {
+		"info",
+		"debug",
+		"warning",
+		"error"
 	};
 
 	LoggableClass *object = nullptr;
 
+	friend class ConsoleSink;
+	friend class Tracer;
+
+	static constexpr uint64_t Repeating = 1;
+
+	// Everything an object needs once it logs (or gets a level of its
+	// own). It's allocated then, so one that never does is just object
+	// and this pointer, and only ever freed with the logger.
+	struct State {
+		~State() { delete ToHeader(header.load(std::memory_order_relaxed)); }
+
+		std::atomic<uintptr_t> header = 0;
+		std::atomic<uint64_t> levels = (NoOverride << OwnShift) | NoOverride;
+
+		// The hash of the last message, while collapsing repeats, with
+		// the low bit set while a run of it is waiting in repeats
+		std::atomic<uint64_t> lastMessage = 0;
+
+		// What typeid said when header and levels were worked out
+		std::atomic<const std::type_info *> type = nullptr;
+	};
+
+	mutable std::atomic<State *> state = nullptr;
+
+	State &GetState() const;
+
+	// A base class constructor that logs caches everything under
+	// the base class. Once typeid sees the real one, it's redone.
+	void CheckType(State &state) const;
+
 	static std::function<void()> onClose;
 };
 
@@ -251,51 +1094,115 @@ public:
 	}
 
 	LoggableClass(std::string &&name) :
-		LoggableClass() {
-		this->name = std::move(name);
+		name(std::move(name)) {
+		logger.SetObject(this);
+	}
+
+	LoggableClass(const LoggableClass &other) :
+		name(other.name) {
+		logger.SetObject(this);
+	}
+
+	LoggableClass &operator=(const LoggableClass &other) {
+		name = other.name;
+		logger.RefreshHeader();
+		return *this;
 	}
 
 	// Make sure destructor is virtual
 	virtual ~LoggableClass() = default;
 
 	template<typename T, typename... Args>
-	void Log(Logger::Level level, T t, Args... args) {
+	void Log(Logger::Level level, const T &t, const Args &... args) {
 		logger.Log(level, t, args...);
 	}
 
 	template<typename T, typename... Args>
-	void LogInfo(T t, Args... args) {
-		logger.LogInfo(t, args...);
+	void LogInfo(const T &t, const Args &... args) {
+		if constexpr (Logger::IsCompiledIn(Logger::Level::Info))
+			logger.LogInfo(t, args...);
 	}
 
 	template<typename T, typename... Args>
-	void LogDebug(T t, Args... args) {
-		logger.LogDebug(t, args...);
+	void LogDebug(const T &t, const Args &... args) {
+		if constexpr (Logger::IsCompiledIn(Logger::Level::Debug))
+			logger.LogDebug(t, args...);
 	}
 
 	template<typename T, typename... Args>
-	void LogWarning(T t, Args... args) {
-		logger.LogWarning(t, args...);
+	void LogWarning(const T &t, const Args &... args) {
+		if constexpr (Logger::IsCompiledIn(Logger::Level::Warning))
+			logger.LogWarning(t, args...);
 	}
 
 	template<typename T, typename... Args>
-	void LogError(T t, Args... args) {
-		logger.LogError(t, args...);
+	void LogError(const T &t, const Args &... args) {
+		if constexpr (Logger::IsCompiledIn(Logger::Level::Error))
+			logger.LogError(t, args...);
 	}
 
+	bool IsLevelEnabled(Logger::Level level) const { return logger.IsLevelEnabled(level); }
+	void HoldSuppressed(LogRateLimiter &limiter, Logger::Level level) const { logger.HoldSuppressed(limiter, level); }
+
+	// Times the rest of the scope under this object, while
+	// Tracer is enabled:
+	//	const auto span = Trace("Load");
+	TraceSpan Trace(const char *name) const { return TraceSpan(name, &logger); }
+
+	// Just this object; see Logger::SetClassLevel for more
+	void SetLogLevel(Logger::Level level) { logger.SetLogLevel(level); }
+	void ResetLogLevel() { logger.ResetLogLevel(); }
+
 	virtual const std::string &GetName() const { return name; }
 
+	void SetName(std::string &&name) {
+		this->name = std::move(name);
+		logger.RefreshHeader();
+	}
+
 protected:
 	Logger logger;
 
 	std::string name;
 };
 
+// Needs typeid(*object), so LoggableClass has to be complete
+inline Logger::Level Logger::GetThreshold() const {
+	const auto *state = this->state.load(std::memory_order_acquire);
+
+	// Nothing worth caching until some override exists
+	if (!state) {
+		if (lowestOverride.load(std::memory_order_relaxed) == NotRecorded) return logLevel;
+		return RefreshThreshold();
+	}
+
+	// Worked out inside a base class constructor
+	if (state->type.load(std::memory_order_relaxed) != &typeid(*object))
+		return RefreshThreshold();
+
+	const auto bits = state->levels.load(std::memory_order_relaxed);
+
+	if ((bits >> EpochShift) != (levelEpoch.load(std::memory_order_relaxed) & EpochMask))
+		return RefreshThreshold();
+
+	const auto cached = bits & LevelMask;
+	return cached == NoOverride ? logLevel : static_cast<Level>(cached);
+}
+
 class LoggableThread : public std::thread, public LoggableClass {
 public:
 	LoggableThread(std::string &&name, std::function<void()> &&f) : std::thread(std::move(f)) {
 		this->name = std::move(name);
 	}
+
+	// Places the thread before it runs f
+	LoggableThread(std::string &&name, ThreadPlacement placement, std::function<void()> &&f) :
+		std::thread([placement = std::move(placement), f = std::move(f)] {
+			placement.Apply();
+			f();
+		}) {
+		this->name = std::move(name);
+	}
 	virtual ~LoggableThread() = default;
 };
 }
\ No newline at end of file
@@ -0,0 +1,272 @@
+#include "Reactor.hpp"
+
+#ifndef WIN32
+
+#include <array>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+namespace Fetcko {
+namespace {
+// Reads one fixed-size thing, retrying if a signal cuts it short
+template<typename T>
+bool ReadOne(int fd, T &t) {
+	while (true) {
+		const auto got = read(fd, &t, sizeof(t));
+		if (got == static_cast<ssize_t>(sizeof(t))) return true;
+		if (got < 0 && errno == EINTR) continue;
+		return false;
+	}
+}
+}
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+Reactor::Reactor() {
+	epoll = epoll_create1(EPOLL_CLOEXEC);
+	wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+	if (epoll == -1 || wake == -1) return;
+
+	epoll_event event {};
+	event.events = EPOLLIN;
+	event.data.fd = wake;
+
+	if (epoll_ctl(epoll, EPOLL_CTL_ADD, wake, &event) != 0) {
+		close(wake);
+		wake = -1;
+	}
+}
+
+Reactor::~Reactor() {
+	// Readers' descriptors belong to whoever added them
+	for (const auto &[fd, source] : sources) {
+		if (source.kind != Kind::Reader)
+			close(fd);
+	}
+
+	for (const auto fd : removed)
+		close(fd);
+
+	if (wake != -1) close(wake);
+	if (epoll != -1) close(epoll);
+}
+
+bool Reactor::Watch(int fd, Source &&source) {
+	epoll_event event {};
+	event.events = EPOLLIN;
+	event.data.fd = fd;
+
+	const auto existing = sources.find(fd);
+	if (epoll_ctl(epoll, existing == sources.end() ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event) != 0)
+		return false;
+
+	sources[fd] = std::move(source);
+	return true;
+}
+
+bool Reactor::AddReader(int fd, Handler f) {
+	if (!IsValid()) return false;
+
+	Source source;
+	source.kind = Kind::Reader;
+	source.f = std::make_shared<const Handler>(std::move(f));
+
+	std::unique_lock lock(sourceMutex);
+	return Watch(fd, std::move(source));
+}
+
+void Reactor::RemoveReader(int fd) {
+	std::unique_lock lock(sourceMutex);
+
+	const auto found = sources.find(fd);
+	if (found == sources.end() || found->second.kind != Kind::Reader) return;
+
+	epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+	sources.erase(found);
+}
+
+int Reactor::AddTimer(std::chrono::nanoseconds period, Handler f) {
+	if (!IsValid() || period.count() <= 0) return -1;
+
+	const auto fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (fd == -1) return -1;
+
+	itimerspec spec {};
+	spec.it_interval.tv_sec = static_cast<time_t>(period.count() / 1'000'000'000);
+	spec.it_interval.tv_nsec = static_cast<long>(period.count() % 1'000'000'000);
+	spec.it_value = spec.it_interval;
+
+	Source source;
+	source.kind = Kind::Timer;
+	source.f = std::make_shared<const Handler>(std::move(f));
+
+	std::unique_lock lock(sourceMutex);
+
+	if (timerfd_settime(fd, 0, &spec, nullptr) != 0 || !Watch(fd, std::move(source))) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+void Reactor::RemoveTimer(int id) {
+	std::unique_lock lock(sourceMutex);
+
+	const auto found = sources.find(id);
+	if (found == sources.end() || found->second.kind != Kind::Timer) return;
+
+	epoll_ctl(epoll, EPOLL_CTL_DEL, id, nullptr);
+	sources.erase(found);
+	removed.push_back(id);
+
+	// So it's closed soon, rather than at the next event
+	const uint64_t one = 1;
+	[[maybe_unused]] const auto written = write(wake, &one, sizeof(one));
+}
+
+bool Reactor::AddSignals(const std::vector<int> &signals, SignalHandler f) {
+	if (!IsValid()) return false;
+
+	std::unique_lock lock(sourceMutex);
+
+	// Everything already being watched stays watched
+	watchedSignals.insert(watchedSignals.end(), signals.begin(), signals.end());
+
+	sigset_t set;
+	sigemptyset(&set);
+
+	for (const auto signal : watchedSignals)
+		sigaddset(&set, signal);
+
+	if (pthread_sigmask(SIG_BLOCK, &set, nullptr) != 0) return false;
+
+	const auto fd = signalfd(this->signals, &set, SFD_CLOEXEC | SFD_NONBLOCK);
+	if (fd == -1) return false;
+
+	Source source;
+	source.kind = Kind::Signals;
+	source.onSignal = std::make_shared<const SignalHandler>(std::move(f));
+
+	if (!Watch(fd, std::move(source))) {
+		if (fd != this->signals) close(fd);
+		return false;
+	}
+
+	this->signals = fd;
+	return true;
+}
+
+void Reactor::Post(Handler f) {
+	{
+		std::unique_lock lock(postMutex);
+		posted.push_back(std::move(f));
+	}
+
+	const uint64_t one = 1;
+	[[maybe_unused]] const auto written = write(wake, &one, sizeof(one));
+}
+
+void Reactor::Stop() {
+	stopping.store(true, std::memory_order_release);
+
+	const uint64_t one = 1;
+	[[maybe_unused]] const auto written = write(wake, &one, sizeof(one));
+}
+
+void Reactor::Run() {
+	while (RunOnce(std::chrono::milliseconds(-1)));
+}
+
+bool Reactor::RunOnce(std::chrono::milliseconds timeout) {
+	if (!IsValid() || IsStopping()) return false;
+
+	std::array<epoll_event, 16> events;
+	const auto count = epoll_wait(epoll, events.data(), static_cast<int>(events.size()), static_cast<int>(timeout.count()));
+
+	for (int i = 0; i < count && !IsStopping(); ++i) {
+		const auto fd = events[static_cast<std::size_t>(i)].data.fd;
+
+		if (fd == wake) {
+			uint64_t value;
+			ReadOne(wake, value);
+			RunPosted();
+		} else {
+			Dispatch(fd);
+		}
+	}
+
+	CloseRemoved();
+
+	return !IsStopping();
+}
+
+void Reactor::Dispatch(int fd) {
+	Source source;
+	{
+		std::unique_lock lock(sourceMutex);
+
+		// Removed by an earlier handler in the same batch
+		const auto found = sources.find(fd);
+		if (found == sources.end()) return;
+
+		source = found->second;
+	}
+
+	switch (source.kind) {
+	case Kind::Reader:
+		(*source.f)();
+		break;
+
+	case Kind::Timer: {
+		// How many periods have passed; they're all handled as one
+		uint64_t expirations;
+		if (ReadOne(fd, expirations))
+			(*source.f)();
+		break;
+	}
+
+	case Kind::Signals: {
+		signalfd_siginfo info;
+		while (ReadOne(fd, info))
+			(*source.onSignal)(static_cast<int>(info.ssi_signo));
+		break;
+	}
+	}
+}
+
+void Reactor::CloseRemoved() {
+	std::vector<int> closing;
+	{
+		std::unique_lock lock(sourceMutex);
+		closing.swap(removed);
+	}
+
+	for (const auto fd : closing)
+		close(fd);
+}
+
+void Reactor::RunPosted() {
+	// Swapped out, so handlers can Post more without deadlocking
+	std::vector<Handler> running;
+	{
+		std::unique_lock lock(postMutex);
+		running.swap(posted);
+	}
+
+	for (auto &f : running)
+		f();
+}
+}
+
+#endif
@@ -0,0 +1,125 @@
+#pragma once
+
+// epoll, eventfd, timerfd and signalfd are Linux's own
+#ifndef WIN32
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Fetcko {
+// A single-threaded event loop over epoll. File descriptors becoming
+// readable, timers and signals are all handled by whichever thread is
+// in Run, one at a time, so handlers never race each other. Other
+// threads wake it through an eventfd, to Post work or Stop it.
+//
+//	Reactor reactor;
+//	reactor.AddTimer(std::chrono::seconds(1), [] { ... });
+//	std::thread thread([&] { reactor.Run(); });
+//	...
+//	reactor.Stop();
+//	thread.join();
+//
+// Everything here may be called from any thread, handlers included.
+class Reactor {
+public:
+	using Handler = std::function<void()>;
+	using SignalHandler = std::function<void(int)>;
+
+	Reactor();
+	~Reactor();
+
+	Reactor(const Reactor &) = delete;
+	Reactor &operator=(const Reactor &) = delete;
+
+	// False if the epoll or eventfd couldn't be created,
+	// in which case nothing else will work either
+	bool IsValid() const { return epoll != -1 && wake != -1; }
+
+	// Calls f while fd has something to read, or has hung up. It's
+	// level-triggered, so f can read as little as it likes. fd isn't
+	// closed by the Reactor. Regular files can't be waited on, and
+	// fail here.
+	bool AddReader(int fd, Handler f);
+	void RemoveReader(int fd);
+
+	// Calls f every period, starting one period from now. However
+	// many periods were missed, f is called once. Returns an id for
+	// RemoveTimer, or -1. A removed timer's descriptor is closed by
+	// the loop thread, once it can't be in the middle of reading it.
+	int AddTimer(std::chrono::nanoseconds period, Handler f);
+	void RemoveTimer(int id);
+
+	// Calls f with each of signals that arrives, instead of running
+	// its handler. They're blocked in the calling thread; they have
+	// to be blocked in every other thread too, or the kernel may still
+	// hand them to one. Threads inherit the mask, so block them before
+	// starting any. Adding more signals replaces f.
+	bool AddSignals(const std::vector<int> &signals, SignalHandler f);
+
+	// Runs f on the loop thread, after whatever it's handling now
+	void Post(Handler f);
+
+	// Handles events until Stop
+	void Run();
+
+	// Waits up to timeout for events and handles them.
+	// Returns false once stopped.
+	bool RunOnce(std::chrono::milliseconds timeout);
+
+	// Run returns once the current handler does. A stopped
+	// Reactor stays stopped.
+	void Stop();
+	bool IsStopping() const { return stopping.load(std::memory_order_acquire); }
+
+private:
+	enum class Kind {
+		Reader,
+		Timer,
+		Signals
+	};
+
+	struct Source {
+		Kind kind = Kind::Reader;
+
+		// Shared so a handler can be called with no lock
+		// held, even if it removes itself
+		std::shared_ptr<const Handler> f;
+		std::shared_ptr<const SignalHandler> onSignal;
+	};
+
+	// Guarded by sourceMutex
+	bool Watch(int fd, Source &&source);
+	void Dispatch(int fd);
+	void RunPosted();
+	void CloseRemoved();
+
+	int epoll = -1;
+	int wake = -1;
+
+	std::atomic<bool> stopping = false;
+
+	// By file descriptor. Timers are their timerfd.
+	// All of these are guarded by sourceMutex.
+	std::mutex sourceMutex;
+	std::map<int, Source> sources;
+
+	// Removed timers, waiting for the loop thread to close them.
+	// Closing one straight away could let its number be reused
+	// while Dispatch is still about to read it.
+	std::vector<int> removed;
+
+	// The one signalfd, and everything it's watching
+	int signals = -1;
+	std::vector<int> watchedSignals;
+
+	std::mutex postMutex;
+	std::vector<Handler> posted;
+};
+}
+
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+namespace Fetcko {
+// Bounded multi-producer / single-consumer queue.
+// Derived from Dmitry Vyukov's bounded MPMC queue:
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+// Each slot carries a sequence number that tells producers and
+// the consumer whose turn it is, so neither side ever takes a lock.
+template<typename T>
+class MpscRingBuffer {
+public:
+	explicit MpscRingBuffer(std::size_t capacity) {
+		// Round up to a power of two so we can mask instead of mod
+		std::size_t size = 2;
+		while (size < capacity) size <<= 1;
+
+		slots = std::make_unique<Slot[]>(size);
+		mask = size - 1;
+
+		for (std::size_t i = 0; i < size; ++i)
+			slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	MpscRingBuffer(const MpscRingBuffer &) = delete;
+	MpscRingBuffer &operator=(const MpscRingBuffer &) = delete;
+
+	// Safe to call from any number of threads.
+	// Returns false (and leaves value untouched) if the buffer is full.
+	bool TryPush(T &&value) {
+		return TryPushWith([&value](T &slot) { slot = std::move(value); });
+	}
+
+	// Like TryPush, but f fills the claimed slot in place.
+	// Handy when T is large and copying it would cost more
+	// than building it.
+	template<typename F>
+	bool TryPushWith(F &&f) {
+		auto position = head.load(std::memory_order_relaxed);
+
+		while (true) {
+			auto &slot = slots[position & mask];
+			const auto sequence = slot.sequence.load(std::memory_order_acquire);
+			const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+
+			if (difference == 0) {
+				if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+					f(slot.value);
+					slot.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			} else if (difference < 0) {
+				// The consumer hasn't freed this slot yet
+				return false;
+			} else {
+				position = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Only ever call this from a single thread
+	bool TryPop(T &value) {
+		return TryPopWith([&value](T &slot) { value = std::move(slot); });
+	}
+
+	// Like TryPop, but f reads the slot in place before it's released
+	template<typename F>
+	bool TryPopWith(F &&f) {
+		auto &slot = slots[tail & mask];
+		const auto sequence = slot.sequence.load(std::memory_order_acquire);
+
+		if (static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(tail + 1) < 0)
+			return false;
+
+		f(slot.value);
+		slot.sequence.store(tail + mask + 1, std::memory_order_release);
+		++tail;
+
+		return true;
+	}
+
+	// Like TryPopWith, but the slot stays where it is.
+	// Only ever call this from the consumer, too.
+	template<typename F>
+	bool TryPeekWith(F &&f) const {
+		const auto &slot = slots[tail & mask];
+		const auto sequence = slot.sequence.load(std::memory_order_acquire);
+
+		if (static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(tail + 1) < 0)
+			return false;
+
+		f(slot.value);
+		return true;
+	}
+
+	// Whether a producer has claimed a slot the consumer hasn't taken,
+	// even if it's still filling it in. Consumer only.
+	bool HasClaimed() const { return head.load(std::memory_order_acquire) != tail; }
+
+	std::size_t Capacity() const { return mask + 1; }
+
+	// Only a snapshot; producers may be mid-push
+	std::size_t SizeApprox() const {
+		const auto h = head.load(std::memory_order_relaxed);
+		const auto t = consumed.load(std::memory_order_relaxed);
+		return h > t ? h - t : 0;
+	}
+
+	// Lets SizeApprox() see the consumer's progress
+	// without making every pop pay for an atomic store
+	void PublishConsumed() { consumed.store(tail, std::memory_order_relaxed); }
+
+private:
+	struct Slot {
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Slot[]> slots;
+	std::size_t mask = 0;
+
+	// Keep producers and the consumer off each other's cache lines
+	alignas(64) std::atomic<std::size_t> head = 0;
+	alignas(64) std::size_t tail = 0;
+	std::atomic<std::size_t> consumed = 0;
+};
+}
\ No newline at end of file
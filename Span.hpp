@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace Fetcko {
+// A non-owning view over contiguous elements,
+// until we can rely on C++20's std::span.
+template<typename T>
+class Span {
+public:
+	constexpr Span() = default;
+	constexpr Span(T *data, std::size_t size) : elements(data), count(size) {}
+
+	template<typename U>
+	Span(const std::vector<U> &vector) : elements(vector.data()), count(vector.size()) {}
+
+	template<typename U>
+	Span(std::vector<U> &vector) : elements(vector.data()), count(vector.size()) {}
+
+	constexpr T *data() const { return elements; }
+	constexpr std::size_t size() const { return count; }
+	constexpr bool empty() const { return count == 0; }
+
+	constexpr T *begin() const { return elements; }
+	constexpr T *end() const { return elements + count; }
+
+	constexpr T &operator[](std::size_t i) const { return elements[i]; }
+	constexpr T &front() const { return elements[0]; }
+	constexpr T &back() const { return elements[count - 1]; }
+
+	constexpr Span subspan(std::size_t offset) const {
+		return offset < count ? Span(elements + offset, count - offset) : Span();
+	}
+
+private:
+	T *elements = nullptr;
+	std::size_t count = 0;
+};
+}
\ No newline at end of file
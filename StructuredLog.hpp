@@ -0,0 +1,180 @@
+#pragma once
+
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+namespace Fetcko {
+// A named value for structured logging:
+//	LogInfo("Request done", kv("latency_us", latency), kv("path", path));
+// Text sinks see "Request done latency_us=12 path=/index.html",
+// JSON sinks get latency_us and path as typed fields.
+template<typename T>
+struct KeyValue {
+	std::string_view key;
+	T value;
+};
+
+template<typename T>
+KeyValue<std::decay_t<T>> kv(std::string_view key, T &&value) {
+	return { key, std::forward<T>(value) };
+}
+
+template<typename T>
+struct IsKeyValue : std::false_type {};
+
+template<typename T>
+struct IsKeyValue<KeyValue<T>> : std::true_type {};
+
+template<typename T>
+std::ostream &operator<<(std::ostream &out, const KeyValue<T> &kv) {
+	out << ' ' << kv.key << '=';
+
+	if constexpr (std::is_same<T, std::filesystem::path>::value)
+		out << kv.value.u8string();
+	else
+		out << kv.value;
+
+	return out;
+}
+
+// Appends JSON to a string the caller owns (and reuses), so once
+// that string has grown to fit a typical line nothing allocates.
+// It doesn't validate structure; callers pair Begin/End themselves.
+class JsonWriter {
+public:
+	explicit JsonWriter(std::string &out) : out(out) {}
+
+	void BeginObject() {
+		Separator();
+		out += '{';
+		first = true;
+	}
+
+	void EndObject() {
+		out += '}';
+		first = false;
+	}
+
+	void BeginArray() {
+		Separator();
+		out += '[';
+		first = true;
+	}
+
+	void EndArray() {
+		out += ']';
+		first = false;
+	}
+
+	void Key(std::string_view key) {
+		Separator();
+		Quoted(key);
+		out += ':';
+
+		// The value that follows doesn't take a comma
+		first = true;
+	}
+
+	void String(std::string_view string) {
+		Separator();
+		Quoted(string);
+	}
+
+	template<typename T>
+	void Number(T t) {
+		Separator();
+
+		if constexpr (std::is_floating_point<T>::value) {
+			// JSON has no NaN or infinity
+			if (!std::isfinite(t)) {
+				out += "null";
+				return;
+			}
+		}
+
+		char digits[32];
+		const auto result = std::to_chars(digits, digits + sizeof(digits), t);
+		out.append(digits, result.ptr - digits);
+	}
+
+	void Bool(bool b) {
+		Separator();
+		out += b ? "true" : "false";
+	}
+
+	// Numbers and bools stay typed; anything
+	// else is streamed and written as a string.
+	template<typename T>
+	void Value(const T &t) {
+		if constexpr (std::is_same<T, bool>::value) {
+			Bool(t);
+		} else if constexpr (std::is_same<T, char>::value) {
+			String(std::string_view(&t, 1));
+		} else if constexpr (std::is_arithmetic<T>::value) {
+			Number(t);
+		} else if constexpr (std::is_same<T, std::filesystem::path>::value) {
+			String(t.u8string());
+		} else if constexpr (std::is_convertible<const T &, std::string_view>::value) {
+			String(std::string_view(t));
+		} else {
+			thread_local std::ostringstream stream;
+			stream.str({});
+			stream.clear();
+			stream << t;
+			String(stream.str());
+		}
+	}
+
+	template<typename T>
+	void Field(std::string_view key, const T &t) {
+		Key(key);
+		Value(t);
+	}
+
+private:
+	void Separator() {
+		if (!first) out += ',';
+		first = false;
+	}
+
+	void Quoted(std::string_view string) {
+		out += '"';
+
+		// Copy runs that need no escaping in one go
+		std::size_t run = 0;
+		for (std::size_t i = 0; i < string.size(); ++i) {
+			const auto c = static_cast<unsigned char>(string[i]);
+			if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+			out.append(string.data() + run, i - run);
+			run = i + 1;
+
+			switch (c) {
+				case '"': out += "\\\""; break;
+				case '\\': out += "\\\\"; break;
+				case '\n': out += "\\n"; break;
+				case '\r': out += "\\r"; break;
+				case '\t': out += "\\t"; break;
+				default: {
+					constexpr std::string_view Digits = "0123456789abcdef";
+					const char escape[] = { '\\', 'u', '0', '0', Digits[c >> 4], Digits[c & 0xF] };
+					out.append(escape, sizeof(escape));
+				}
+			}
+		}
+
+		out.append(string.data() + run, string.size() - run);
+		out += '"';
+	}
+
+	std::string &out;
+	bool first = true;
+};
+}
\ No newline at end of file
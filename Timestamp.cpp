@@ -0,0 +1,258 @@
+#include "Timestamp.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <thread>
+
+#ifdef WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+
+	#include <windows.h>
+	#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+	#define FETCKO_HAS_TSC
+#endif
+
+namespace Fetcko {
+// ===============================================
+// =========== Initializing Statics ==============
+// ===============================================
+std::atomic<Timestamp::Source> Timestamp::source = Timestamp::Source::System;
+std::atomic<int> Timestamp::subsecondDigits = 0;
+
+int64_t Timestamp::anchorNanoseconds = 0;
+uint64_t Timestamp::anchorTicks = 0;
+double Timestamp::nanosecondsPerTick = 1.0;
+
+std::atomic<uint64_t> Timestamp::cacheSequence = 0;
+std::atomic<int64_t> Timestamp::cacheSecond = -1;
+std::array<std::atomic<uint64_t>, Timestamp::CacheWords> Timestamp::cacheText {};
+
+namespace {
+int64_t SystemNanoseconds() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::system_clock::now().time_since_epoch()
+	).count();
+}
+
+bool HasCoarseClock() {
+#if defined(WIN32) || defined(CLOCK_MONOTONIC_COARSE)
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint64_t CoarseTicks() {
+#ifdef WIN32
+	// Milliseconds, but about as cheap as a clock gets
+	return GetTickCount64() * 1000000;
+#elif defined(CLOCK_MONOTONIC_COARSE)
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &time);
+	return static_cast<uint64_t>(time.tv_sec) * 1000000000 + time.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+uint64_t TscTicks() {
+#ifdef FETCKO_HAS_TSC
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+bool LocalTime(std::time_t time, std::tm &tm) {
+#ifdef WIN32
+	return localtime_s(&tm, &time) == 0;
+#else
+	return localtime_r(&time, &tm) != nullptr;
+#endif
+}
+}
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+void Timestamp::SetSource(Source source) {
+	if (source == Source::CoarseMonotonic && !HasCoarseClock())
+		source = Source::System;
+
+#ifndef FETCKO_HAS_TSC
+	if (source == Source::Tsc)
+		source = Source::System;
+#endif
+
+	// Fall back to system_clock while we recalibrate
+	Timestamp::source.store(Source::System, std::memory_order_release);
+
+	if (source == Source::CoarseMonotonic) {
+		anchorTicks = CoarseTicks();
+		anchorNanoseconds = SystemNanoseconds();
+		nanosecondsPerTick = 1.0;
+	} else if (source == Source::Tsc) {
+		Calibrate();
+	}
+
+	Timestamp::source.store(source, std::memory_order_release);
+}
+
+void Timestamp::Calibrate() {
+	// Measure the TSC frequency against system_clock
+	// over a short sleep. 20ms keeps the error well
+	// below a microsecond per second of drift.
+	const auto startTicks = TscTicks();
+	const auto startNanoseconds = SystemNanoseconds();
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	const auto endTicks = TscTicks();
+	const auto endNanoseconds = SystemNanoseconds();
+
+	if (endTicks <= startTicks) return;
+
+	nanosecondsPerTick = static_cast<double>(endNanoseconds - startNanoseconds) / static_cast<double>(endTicks - startTicks);
+	anchorTicks = endTicks;
+	anchorNanoseconds = endNanoseconds;
+}
+
+void Timestamp::SetSubsecondDigits(int digits) {
+	if (digits <= 0) digits = 0;
+	else if (digits <= 3) digits = 3;
+	else if (digits <= 6) digits = 6;
+	else digits = 9;
+
+	subsecondDigits.store(digits, std::memory_order_relaxed);
+}
+
+int64_t Timestamp::Now() {
+	switch (source.load(std::memory_order_acquire)) {
+		case Source::CoarseMonotonic:
+			return anchorNanoseconds + static_cast<int64_t>(CoarseTicks() - anchorTicks);
+		case Source::Tsc:
+			return anchorNanoseconds + static_cast<int64_t>(static_cast<double>(TscTicks() - anchorTicks) * nanosecondsPerTick);
+		default:
+			return SystemNanoseconds();
+	}
+}
+
+std::string_view Timestamp::Format(int64_t nanoseconds, char *out) {
+	const auto second = nanoseconds / 1000000000;
+	std::array<uint64_t, CacheWords> words;
+	bool hit = false;
+
+	// Seqlock read: an odd sequence means a writer is mid-update
+	if (const auto sequence = cacheSequence.load(std::memory_order_acquire);
+		!(sequence & 1) && cacheSecond.load(std::memory_order_relaxed) == second) {
+		for (std::size_t i = 0; i < CacheWords; ++i)
+			words[i] = cacheText[i].load(std::memory_order_relaxed);
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+		hit = cacheSequence.load(std::memory_order_relaxed) == sequence;
+	}
+
+	std::size_t length = SecondsLength;
+
+	if (hit) {
+		std::memcpy(out, words.data(), SecondsLength);
+	} else {
+		std::tm tm {};
+		char text[sizeof(words) + 1] {};
+
+		length = 0;
+		if (LocalTime(static_cast<std::time_t>(second), tm))
+			length = std::strftime(text, sizeof(text), "%d%b%Y %H:%M:%S", &tm);
+
+		std::memcpy(out, text, length);
+
+		// Only one thread needs to publish; anyone
+		// who loses the race just keeps their copy.
+		auto sequence = cacheSequence.load(std::memory_order_relaxed);
+		if (length == SecondsLength && !(sequence & 1) &&
+			cacheSequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire)) {
+			std::atomic_thread_fence(std::memory_order_release);
+
+			std::memcpy(words.data(), text, sizeof(words));
+			for (std::size_t i = 0; i < CacheWords; ++i)
+				cacheText[i].store(words[i], std::memory_order_relaxed);
+			cacheSecond.store(second, std::memory_order_relaxed);
+
+			cacheSequence.store(sequence + 2, std::memory_order_release);
+		}
+	}
+
+	if (const auto digits = subsecondDigits.load(std::memory_order_relaxed); digits) {
+		auto fraction = static_cast<uint64_t>(nanoseconds % 1000000000);
+		for (int i = digits; i < 9; ++i) fraction /= 10;
+
+		out[length] = '.';
+		for (int i = digits; i > 0; --i) {
+			out[length + i] = static_cast<char>('0' + fraction % 10);
+			fraction /= 10;
+		}
+
+		length += digits + 1;
+	}
+
+	return std::string_view(out, length);
+}
+
+std::size_t Timestamp::Parse(std::string_view text, int64_t &nanoseconds) {
+	// As strftime writes %b in the C locale
+	constexpr std::string_view Months = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+	if (text.size() < SecondsLength) return 0;
+
+	const auto number = [&](std::size_t at, std::size_t digits, int &out) {
+		out = 0;
+		for (std::size_t i = at; i < at + digits; ++i) {
+			if (text[i] < '0' || text[i] > '9') return false;
+			out = out * 10 + (text[i] - '0');
+		}
+		return true;
+	};
+
+	std::tm tm {};
+	const auto month = Months.find(text.substr(2, 3));
+
+	if (month == std::string_view::npos || month % 3 ||
+		!number(0, 2, tm.tm_mday) ||
+		!number(5, 4, tm.tm_year) ||
+		text[9] != ' ' ||
+		!number(10, 2, tm.tm_hour) || text[12] != ':' ||
+		!number(13, 2, tm.tm_min) || text[15] != ':' ||
+		!number(16, 2, tm.tm_sec))
+		return 0;
+
+	tm.tm_mon = static_cast<int>(month / 3);
+	tm.tm_year -= 1900;
+
+	// Local time, like Format, with mktime working out DST
+	tm.tm_isdst = -1;
+	const auto seconds = std::mktime(&tm);
+	if (seconds == static_cast<std::time_t>(-1)) return 0;
+
+	std::size_t length = SecondsLength;
+	int64_t fraction = 0;
+
+	if (length < text.size() && text[length] == '.') {
+		int64_t scale = 100000000;
+		for (++length; length < text.size() && text[length] >= '0' && text[length] <= '9'; ++length) {
+			fraction += (text[length] - '0') * scale;
+			scale /= 10;
+		}
+	}
+
+	nanoseconds = static_cast<int64_t>(seconds) * 1000000000 + fraction;
+	return length;
+}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Fetcko {
+// Cheap timestamps for log headers.
+//
+// The "%d%b%Y %H:%M:%S" part only changes once a second, so it's
+// formatted once and cached; every other call in that second is a
+// copy. The clock itself can be swapped for a coarse monotonic clock
+// or a calibrated TSC when system_clock::now() is too slow.
+class Timestamp {
+public:
+	enum class Source {
+		System,				// std::chrono::system_clock
+		CoarseMonotonic,	// CLOCK_MONOTONIC_COARSE (Linux), anchored to wall time
+		Tsc					// Calibrated rdtsc (x86 only)
+	};
+
+	// "17Oct2026 01:34:47" plus up to ".123456789"
+	static constexpr std::size_t SecondsLength = 18;
+	static constexpr std::size_t MaxLength = SecondsLength + 10;
+
+	// Both of these re-anchor the clock to wall time, so call them
+	// before logging starts. Sources that aren't available on this
+	// platform fall back to System.
+	static void SetSource(Source source);
+	static Source GetSource() { return source.load(std::memory_order_relaxed); }
+
+	// 0 (the default), 3, 6 or 9 digits after the seconds
+	static void SetSubsecondDigits(int digits);
+
+	// Nanoseconds since the system_clock epoch, from the current source
+	static int64_t Now();
+
+	// Writes the header timestamp for nanoseconds into out,
+	// which must hold at least MaxLength chars.
+	static std::string_view Format(int64_t nanoseconds, char *out);
+
+	// The other way, for tools reading logs back. Takes any number
+	// of subsecond digits, and returns how many chars it read, or 0
+	// if text doesn't start with a timestamp.
+	static std::size_t Parse(std::string_view text, int64_t &nanoseconds);
+
+private:
+	static void Calibrate();
+
+	static std::atomic<Source> source;
+	static std::atomic<int> subsecondDigits;
+
+	// Where the current source's zero lies in wall time
+	static int64_t anchorNanoseconds;
+	static uint64_t anchorTicks;
+	static double nanosecondsPerTick;
+
+	// A seqlock over the cached seconds text.
+	// The text lives in atomic words so readers
+	// racing a writer never touch a torn char.
+	static constexpr std::size_t CacheWords = (SecondsLength + 7) / 8;
+
+	static std::atomic<uint64_t> cacheSequence;
+	static std::atomic<int64_t> cacheSecond;
+	static std::array<std::atomic<uint64_t>, CacheWords> cacheText;
+};
+}
\ No newline at end of file
@@ -0,0 +1,281 @@
+#include "Topology.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <set>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+
+#ifdef WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+
+	#include <windows.h>
+#else
+	#include <sched.h>
+	#include <sys/resource.h>
+	#include <sys/syscall.h>
+	#include <unistd.h>
+#endif
+
+#include "Logger.hpp"
+
+namespace Fetcko {
+namespace {
+LoggableClass &ErrorLog() {
+	static LoggableClass errorLog(typeid(ThreadPlacement).name());
+	return errorLog;
+}
+
+std::string FormatCpuList(const std::vector<unsigned> &cpus) {
+	std::string ret;
+
+	for (std::size_t i = 0; i < cpus.size();) {
+		auto j = i;
+		while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+
+		if (!ret.empty()) ret += ',';
+		ret += std::to_string(cpus[i]);
+		if (j > i) ret += '-' + std::to_string(cpus[j]);
+
+		i = j + 1;
+	}
+
+	return ret;
+}
+
+std::vector<unsigned> CpusFor(const ThreadPlacement &placement) {
+	return placement.cpus.empty() && placement.node >= 0 ?
+		Topology::NodeCpus(placement.node) :
+		placement.cpus;
+}
+
+#ifndef WIN32
+// /sys files are one line; missing ones read as empty
+std::string ReadLine(const std::filesystem::path &path) {
+	std::ifstream file(path);
+	std::string ret;
+	std::getline(file, ret);
+	return ret;
+}
+
+unsigned ReadUnsigned(const std::filesystem::path &path, unsigned fallback) {
+	const auto text = ReadLine(path);
+	char *end = nullptr;
+	const auto value = std::strtoul(text.c_str(), &end, 10);
+	return end != text.c_str() ? static_cast<unsigned>(value) : fallback;
+}
+
+std::vector<Topology::Cpu> ReadCpus() {
+	const std::filesystem::path cpuRoot = "/sys/devices/system/cpu";
+	const std::filesystem::path nodeRoot = "/sys/devices/system/node";
+
+	std::vector<Topology::Cpu> ret;
+
+	for (const auto id : Topology::ParseCpuList(ReadLine(cpuRoot / "online"))) {
+		const auto topology = cpuRoot / ("cpu" + std::to_string(id)) / "topology";
+
+		Topology::Cpu cpu;
+		cpu.id = id;
+		cpu.core = ReadUnsigned(topology / "core_id", id);
+		cpu.package = ReadUnsigned(topology / "physical_package_id", 0);
+		ret.push_back(cpu);
+	}
+
+	std::error_code error;
+	for (const auto &entry : std::filesystem::directory_iterator(nodeRoot, error)) {
+		const auto name = entry.path().filename().string();
+		if (name.size() <= 4 || name.compare(0, 4, "node") != 0 || !std::isdigit(static_cast<unsigned char>(name[4])))
+			continue;
+
+		const auto node = std::stoi(name.substr(4));
+		for (const auto id : Topology::ParseCpuList(ReadLine(entry.path() / "cpulist"))) {
+			for (auto &cpu : ret) {
+				if (cpu.id == id) cpu.node = node;
+			}
+		}
+	}
+
+	return ret;
+}
+#endif
+}
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+#ifdef WIN32
+bool ThreadPlacement::Apply() const {
+	bool ok = true;
+
+	if (const auto cpus = CpusFor(*this); !cpus.empty()) {
+		DWORD_PTR mask = 0;
+		for (const auto cpu : cpus) {
+			if (cpu < sizeof(mask) * 8)
+				mask |= DWORD_PTR(1) << cpu;
+		}
+
+		if (!SetThreadAffinityMask(GetCurrentThread(), mask)) {
+			ErrorLog().LogWarning("Couldn't pin thread to CPUs ", FormatCpuList(cpus), ": error ", GetLastError());
+			ok = false;
+		}
+	}
+
+	if (priority && !SetThreadPriority(GetCurrentThread(), *priority)) {
+		ErrorLog().LogWarning("Couldn't set thread priority to ", *priority, ": error ", GetLastError());
+		ok = false;
+	}
+
+	return ok;
+}
+#else
+bool ThreadPlacement::Apply() const {
+	bool ok = ApplyTo(CurrentThreadId());
+
+#ifdef SYS_set_mempolicy
+	if (node >= 0) {
+		// MPOL_PREFERRED, from <numaif.h>, which
+		// comes with libnuma rather than libc
+		constexpr int PreferredPolicy = 1;
+		constexpr std::size_t WordBits = sizeof(unsigned long) * 8;
+
+		std::vector<unsigned long> mask(static_cast<std::size_t>(node) / WordBits + 1);
+		mask[static_cast<std::size_t>(node) / WordBits] |= 1ul << (static_cast<std::size_t>(node) % WordBits);
+
+		// The kernel counts one bit fewer than it's told
+		if (syscall(SYS_set_mempolicy, PreferredPolicy, mask.data(), mask.size() * WordBits + 1) != 0) {
+			const auto error = errno;
+			ErrorLog().LogWarning("Couldn't prefer memory from node ", node, ": ", std::strerror(error));
+			ok = false;
+		}
+	}
+#endif
+
+	return ok;
+}
+
+bool ThreadPlacement::ApplyTo(pid_t thread) const {
+	bool ok = true;
+
+	if (const auto cpus = CpusFor(*this); !cpus.empty()) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (const auto cpu : cpus) {
+			if (cpu < CPU_SETSIZE)
+				CPU_SET(cpu, &set);
+		}
+
+		if (sched_setaffinity(thread, sizeof(set), &set) != 0) {
+			const auto error = errno;
+			ErrorLog().LogWarning("Couldn't pin thread ", thread, " to CPUs ", FormatCpuList(cpus), ": ", std::strerror(error));
+			ok = false;
+		}
+	}
+
+	// Per thread on Linux, whatever POSIX says
+	if (priority && setpriority(PRIO_PROCESS, static_cast<id_t>(thread), *priority) != 0) {
+		const auto error = errno;
+		ErrorLog().LogWarning("Couldn't set thread ", thread, "'s priority to ", *priority, ": ", std::strerror(error));
+		ok = false;
+	}
+
+	return ok;
+}
+
+pid_t ThreadPlacement::CurrentThreadId() {
+	return static_cast<pid_t>(syscall(SYS_gettid));
+}
+#endif
+
+const std::vector<Topology::Cpu> &Topology::Cpus() {
+	static const std::vector<Cpu> cpus = [] {
+		std::vector<Cpu> ret;
+
+#ifndef WIN32
+		ret = ReadCpus();
+#endif
+
+		if (ret.empty()) {
+			const auto count = std::max(1u, std::thread::hardware_concurrency());
+			for (unsigned i = 0; i < count; ++i)
+				ret.push_back({ i, i, 0, 0 });
+		}
+
+		return ret;
+	}();
+
+	return cpus;
+}
+
+std::size_t Topology::NodeCount() {
+	int highest = 0;
+	for (const auto &cpu : Cpus())
+		highest = std::max(highest, cpu.node);
+
+	return static_cast<std::size_t>(highest) + 1;
+}
+
+std::vector<unsigned> Topology::NodeCpus(int node) {
+	std::vector<unsigned> ret;
+	for (const auto &cpu : Cpus()) {
+		if (cpu.node == node)
+			ret.push_back(cpu.id);
+	}
+
+	return ret;
+}
+
+std::vector<unsigned> Topology::PhysicalCores(int node) {
+	std::vector<unsigned> ret;
+	std::set<std::pair<unsigned, unsigned>> seen;
+
+	for (const auto &cpu : Cpus()) {
+		if (node >= 0 && cpu.node != node) continue;
+
+		if (seen.insert({ cpu.package, cpu.core }).second)
+			ret.push_back(cpu.id);
+	}
+
+	return ret;
+}
+
+std::vector<unsigned> Topology::ParseCpuList(std::string_view list) {
+	std::vector<unsigned> ret;
+
+	while (!list.empty()) {
+		const auto comma = list.find(',');
+		const auto range = list.substr(0, comma);
+		list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+
+		unsigned first = 0;
+		unsigned last = 0;
+		std::size_t i = 0;
+
+		// Trailing newlines and the like just end the number
+		while (i < range.size() && range[i] >= '0' && range[i] <= '9')
+			first = first * 10 + static_cast<unsigned>(range[i++] - '0');
+
+		if (!i) continue;
+		last = first;
+
+		if (i < range.size() && range[i] == '-') {
+			last = 0;
+			while (++i < range.size() && range[i] >= '0' && range[i] <= '9')
+				last = last * 10 + static_cast<unsigned>(range[i] - '0');
+		}
+
+		for (auto cpu = first; cpu <= last; ++cpu)
+			ret.push_back(cpu);
+	}
+
+	return ret;
+}
+}
\ No newline at end of file
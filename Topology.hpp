@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#ifndef WIN32
+	#include <sys/types.h>
+#endif
+
+namespace Fetcko {
+// Where a thread runs, and where its memory comes from
+struct ThreadPlacement {
+	// Logical CPUs to run on. Empty means anywhere,
+	// unless node is set, in which case it's that node's.
+	std::vector<unsigned> cpus;
+
+	// NUMA node to prefer for memory the thread allocates from here
+	// on (set_mempolicy's MPOL_PREFERRED). -1 leaves it to the kernel.
+	// Ignored on Windows, other than for picking CPUs.
+	int node = -1;
+
+	// A nice value, -20 (first) to 19 (last); going below 0 needs
+	// CAP_SYS_NICE. On Windows, one of the THREAD_PRIORITY_ values.
+	std::optional<int> priority;
+
+	bool IsEmpty() const { return cpus.empty() && node < 0 && !priority; }
+
+	// Places the calling thread. Anything that doesn't take is logged
+	// and the rest still applied. Returns whether everything took.
+	bool Apply() const;
+
+#ifndef WIN32
+	// Places another thread by its kernel thread id,
+	// all but node, which only a thread can set for itself
+	bool ApplyTo(pid_t thread) const;
+
+	static pid_t CurrentThreadId();
+#endif
+};
+
+// What the machine looks like, read from /sys/devices/system once,
+// for working out placements. Where there's no /sys, it's one node
+// of hardware_concurrency CPUs, each its own core.
+class Topology {
+public:
+	struct Cpu {
+		unsigned id = 0;
+
+		// core is only unique within a package (socket);
+		// hyperthreads share both
+		unsigned core = 0;
+		unsigned package = 0;
+
+		int node = 0;
+	};
+
+	// Online CPUs, by id
+	static const std::vector<Cpu> &Cpus();
+
+	static std::size_t NodeCount();
+	static std::vector<unsigned> NodeCpus(int node);
+
+	// The first CPU of each physical core, on node or on all of them,
+	// for spreading workers so no two share a core
+	static std::vector<unsigned> PhysicalCores(int node = -1);
+
+	// Parses the "0-3,8,10-11" lists /sys uses
+	static std::vector<unsigned> ParseCpuList(std::string_view list);
+};
+}
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "Tracer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+#ifdef WIN32
+	#ifndef WIN32_LEAN_AND_MEAN
+		#define WIN32_LEAN_AND_MEAN
+	#endif
+
+	#include <windows.h>
+	#include <process.h>
+#else
+	#include <unistd.h>
+#endif
+
+#include "Logger.hpp"
+#include "StructuredLog.hpp"
+#include "Topology.hpp"
+
+namespace Fetcko {
+// ===============================================
+// =========== Initializing Statics ==============
+// ===============================================
+std::atomic<bool> Tracer::enabled = false;
+std::atomic<std::size_t> Tracer::eventsPerThread = 16384;
+
+std::mutex Tracer::registryMutex;
+std::vector<std::shared_ptr<Tracer::ThreadBuffer>> Tracer::buffers;
+
+namespace {
+// Set before the thread has a buffer to put it in
+thread_local std::string threadName;
+
+uint64_t CurrentThreadId() {
+#ifdef WIN32
+	return GetCurrentThreadId();
+#else
+	return static_cast<uint64_t>(ThreadPlacement::CurrentThreadId());
+#endif
+}
+
+uint64_t CurrentProcessId() {
+#ifdef WIN32
+	return static_cast<uint64_t>(_getpid());
+#else
+	return static_cast<uint64_t>(getpid());
+#endif
+}
+}
+
+// ===============================================
+// ============= Member Functions ================
+// ===============================================
+void Tracer::Enable(std::size_t eventsPerThread) {
+	Tracer::eventsPerThread.store(eventsPerThread, std::memory_order_relaxed);
+	enabled.store(true, std::memory_order_relaxed);
+}
+
+void Tracer::SetThreadName(std::string name) {
+	threadName = std::move(name);
+
+	if (auto &buffer = LocalBuffer(); buffer) {
+		std::unique_lock lock(registryMutex);
+		buffer->threadName = threadName;
+	}
+}
+
+void Tracer::Clear() {
+	std::unique_lock lock(registryMutex);
+
+	// Buffers whose thread has gone have nothing more
+	// to give; the rest start over from where they are
+	buffers.erase(std::remove_if(buffers.begin(), buffers.end(), [](const auto &buffer) {
+		return buffer.use_count() == 1;
+	}), buffers.end());
+
+	for (auto &buffer : buffers) {
+		for (std::size_t i = 0; i <= buffer->mask; ++i)
+			buffer->slots[i].sequence.store(0, std::memory_order_relaxed);
+	}
+}
+
+std::shared_ptr<Tracer::ThreadBuffer> &Tracer::LocalBuffer() {
+	thread_local std::shared_ptr<ThreadBuffer> buffer;
+	return buffer;
+}
+
+Tracer::ThreadBuffer &Tracer::GetThreadBuffer() {
+	auto &buffer = LocalBuffer();
+	if (buffer) return *buffer;
+
+	std::size_t size = 2;
+	while (size < eventsPerThread.load(std::memory_order_relaxed)) size <<= 1;
+
+	auto fresh = std::make_shared<ThreadBuffer>();
+	fresh->slots = std::make_unique<Slot[]>(size);
+	fresh->mask = size - 1;
+	fresh->threadId = CurrentThreadId();
+
+	{
+		std::unique_lock lock(registryMutex);
+		fresh->threadName = threadName;
+		buffers.push_back(fresh);
+	}
+
+	buffer = std::move(fresh);
+	return *buffer;
+}
+
+void Tracer::Record(const char *name, const Logger *logger, int64_t start, int64_t end) {
+	auto &buffer = GetThreadBuffer();
+
+	Event event;
+	event.name = name;
+	event.start = start;
+	event.end = end;
+
+	if (logger) {
+		event.className = logger->GetClassName();
+		event.object = logger->object;
+
+		const auto &objectName = logger->GetObjectName();
+		event.objectNameLength = static_cast<uint8_t>(std::min(objectName.size(), sizeof(event.objectName)));
+		std::memcpy(event.objectName, objectName.data(), event.objectNameLength);
+	}
+
+	const auto index = buffer.cursor.load(std::memory_order_relaxed);
+	auto &slot = buffer.slots[index & buffer.mask];
+
+	// Same as FlightRecorder: zero while we write
+	slot.sequence.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	uint64_t words[EventWords] = {};
+	std::memcpy(words, &event, sizeof(event));
+	for (std::size_t i = 0; i < EventWords; ++i)
+		slot.words[i].store(words[i], std::memory_order_relaxed);
+
+	slot.sequence.store(index + 1, std::memory_order_release);
+	buffer.cursor.store(index + 1, std::memory_order_release);
+}
+
+std::string Tracer::ExportChromeTrace() {
+	struct Copied {
+		Event event;
+		uint64_t threadId;
+	};
+
+	std::vector<Copied> events;
+	std::vector<std::pair<uint64_t, std::string>> threadNames;
+
+	{
+		std::unique_lock lock(registryMutex);
+
+		for (const auto &buffer : buffers) {
+			if (!buffer->threadName.empty())
+				threadNames.emplace_back(buffer->threadId, buffer->threadName);
+
+			const auto end = buffer->cursor.load(std::memory_order_acquire);
+			const auto begin = end > buffer->mask + 1 ? end - (buffer->mask + 1) : 0;
+
+			for (auto i = begin; i < end; ++i) {
+				const auto &slot = buffer->slots[i & buffer->mask];
+				if (slot.sequence.load(std::memory_order_acquire) != i + 1) continue;
+
+				uint64_t words[EventWords];
+				for (std::size_t j = 0; j < EventWords; ++j)
+					words[j] = slot.words[j].load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+
+				if (slot.sequence.load(std::memory_order_relaxed) != i + 1) continue;
+
+				Copied copied;
+				std::memcpy(&copied.event, words, sizeof(copied.event));
+
+				copied.threadId = buffer->threadId;
+				events.push_back(copied);
+			}
+		}
+	}
+
+	// Timestamps are relative to the first span, since microseconds
+	// since the epoch in a double can't keep nanoseconds
+	int64_t origin = std::numeric_limits<int64_t>::max();
+	for (const auto &copied : events)
+		origin = std::min(origin, copied.event.start);
+
+	const auto processId = CurrentProcessId();
+
+	std::string ret;
+	ret.reserve(events.size() * 160 + 64);
+
+	JsonWriter out(ret);
+	out.BeginObject();
+	out.Key("traceEvents");
+	out.BeginArray();
+
+	for (const auto &[threadId, name] : threadNames) {
+		out.BeginObject();
+		out.Field("name", "thread_name");
+		out.Field("ph", "M");
+		out.Field("pid", processId);
+		out.Field("tid", threadId);
+		out.Key("args");
+		out.BeginObject();
+		out.Field("name", name);
+		out.EndObject();
+		out.EndObject();
+	}
+
+	for (const auto &[event, threadId] : events) {
+		out.BeginObject();
+		out.Field("name", event.name);
+		if (!event.className.empty()) out.Field("cat", event.className);
+		out.Field("ph", "X");
+		out.Field("ts", static_cast<double>(event.start - origin) / 1000.0);
+		out.Field("dur", static_cast<double>(event.end - event.start) / 1000.0);
+		out.Field("pid", processId);
+		out.Field("tid", threadId);
+
+		if (event.object) {
+			char address[Logger::AddressLength];
+
+			out.Key("args");
+			out.BeginObject();
+			if (event.objectNameLength)
+				out.Field("object", std::string_view(event.objectName, event.objectNameLength));
+			out.Field("address", Logger::FormatAddress(event.object, address));
+			out.EndObject();
+		}
+
+		out.EndObject();
+	}
+
+	out.EndArray();
+	out.Field("displayTimeUnit", "ns");
+	out.EndObject();
+
+	return ret;
+}
+
+bool Tracer::WriteChromeTrace(const std::filesystem::path &path) {
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file) return false;
+
+	const auto trace = ExportChromeTrace();
+	file.write(trace.data(), static_cast<std::streamsize>(trace.size()));
+
+	return static_cast<bool>(file);
+}
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "Timestamp.hpp"
+
+namespace Fetcko {
+class Logger;
+
+// Collects TraceSpans into a ring per thread, for loading into
+// chrome://tracing or ui.perfetto.dev. Recording a span is two
+// Timestamp::Nows and a copy into the ring, with no locks; when
+// tracing is off, a span costs one relaxed load.
+//
+//	Tracer::Enable();
+//	...
+//	Tracer::WriteChromeTrace("trace.json");
+class Tracer {
+public:
+	// Threads get a ring of eventsPerThread spans (88 bytes each) the
+	// first time they record one. Once full, the oldest are overwritten.
+	static void Enable(std::size_t eventsPerThread = 16384);
+	static void Disable() { enabled.store(false, std::memory_order_relaxed); }
+	static bool IsEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+	// What the calling thread shows up as; by default, just its id
+	static void SetThreadName(std::string name);
+
+	// Forgets everything recorded so far
+	static void Clear();
+
+	// Chrome's trace event format. Spans still being written
+	// to while this runs are left out.
+	static std::string ExportChromeTrace();
+	static bool WriteChromeTrace(const std::filesystem::path &path);
+
+	static void Record(const char *name, const Logger *logger, int64_t start, int64_t end);
+
+private:
+	struct Event {
+		const char *name = nullptr;
+
+		// Interned by Logger, so it lives as long as the program
+		std::string_view className;
+		const void *object = nullptr;
+
+		int64_t start = 0;
+		int64_t end = 0;
+
+		// Copied, since the object may be gone by the export.
+		// Long names are cut short.
+		char objectName[31] = {};
+		uint8_t objectNameLength = 0;
+	};
+
+	static_assert(std::is_trivially_copyable<Event>::value, "events are copied as words");
+	static constexpr std::size_t EventWords = (sizeof(Event) + 7) / 8;
+
+	struct Slot {
+		// index + 1 of the event in it, 0 while it's being written
+		std::atomic<uint64_t> sequence = 0;
+
+		// The event, in atomic words so an export
+		// racing a writer never reads a torn byte
+		std::array<std::atomic<uint64_t>, EventWords> words {};
+	};
+
+	struct ThreadBuffer {
+		std::unique_ptr<Slot[]> slots;
+		std::size_t mask = 0;
+
+		// Only its own thread writes
+		std::atomic<uint64_t> cursor = 0;
+
+		uint64_t threadId = 0;
+
+		// Guarded by registryMutex
+		std::string threadName;
+	};
+
+	static std::shared_ptr<ThreadBuffer> &LocalBuffer();
+	static ThreadBuffer &GetThreadBuffer();
+
+	static std::atomic<bool> enabled;
+	static std::atomic<std::size_t> eventsPerThread;
+
+	// Buffers outlive their threads, so an export
+	// still has whatever they recorded
+	static std::mutex registryMutex;
+	static std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+};
+
+// Times its own scope. name isn't copied, so it has
+// to outlive the export; a string literal, typically.
+class TraceSpan {
+public:
+	explicit TraceSpan(const char *name, const Logger *logger = nullptr) :
+		name(name),
+		logger(logger),
+		start(Tracer::IsEnabled() ? Timestamp::Now() : 0) {}
+
+	~TraceSpan() {
+		if (start)
+			Tracer::Record(name, logger, start, Timestamp::Now());
+	}
+
+	TraceSpan(const TraceSpan &) = delete;
+	TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+	const char *name;
+	const Logger *logger;
+	int64_t start;
+};
+}
\ No newline at end of file
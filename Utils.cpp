@@ -14,8 +14,9 @@ std::string Utils::GetStringFromFile(const std::filesystem::path & path) {
 	std::ifstream inFile(path, std::ios::in | std::ios::binary);
 
 	if (!inFile) {
-		LoggableClass errorLog(typeid(Utils).name());
-		errorLog.LogError("File ", path.u8string(), " not found");
+		// One for every call, rather than one per error
+		static LoggableClass errorLog(typeid(Utils).name());
+		errorLog.LogError("File ", path, " not found");
 
 		return "";
 	}
@@ -1,10 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <codecvt>
 #include <filesystem>
 #include <fstream>
 #include <optional>
 #include <sstream>
+#include <string_view>
 #include <typeindex>
 #include <vector>
 
@@ -80,6 +82,38 @@ public:
 		} else return { s };
 	}
 
+	// Splits s on whitespace into views over s, reusing tokens' storage.
+	// A token wrapped in double or single quotes may contain whitespace;
+	// the view leaves the quotes off. There are no escapes.
+	template<typename T>
+	static void Tokenize(std::basic_string_view<T> s, std::vector<std::basic_string_view<T>> &tokens) {
+		const auto isSpace = [](T c) {
+			return c == T(' ') || c == T('\t') || c == T('\r') || c == T('\n');
+		};
+
+		tokens.clear();
+
+		std::size_t index = 0;
+		while (index < s.size()) {
+			while (index < s.size() && isSpace(s[index])) ++index;
+			if (index >= s.size()) break;
+
+			if (const auto quote = s[index]; quote == T('"') || quote == T('\'')) {
+				const auto start = ++index;
+				while (index < s.size() && s[index] != quote) ++index;
+
+				// An unterminated quote runs to the end of the line
+				tokens.emplace_back(s.substr(start, index - start));
+				if (index < s.size()) ++index;
+			} else {
+				const auto start = index;
+				while (index < s.size() && !isSpace(s[index])) ++index;
+
+				tokens.emplace_back(s.substr(start, index - start));
+			}
+		}
+	}
+
 	template<typename T>
 	static std::vector<std::basic_string<T>> Split(const std::basic_string<T> &s, int(*f)(int)) {
 		// The is...() functions (which are the expected 2nd argument)
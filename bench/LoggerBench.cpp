@@ -0,0 +1,283 @@
+// Measures LoggableClass::LogInfo from the caller's side, with
+// 1 to N threads all logging through the same Logger statics.
+//
+//	Utils_logger_bench [--threads N] [--messages M]
+//
+// N defaults to the number of hardware threads, M (messages per
+// thread) to 20000. Each call is timed with steady_clock, which
+// adds a few tens of nanoseconds to every latency reported.
+// Throughput counts until everything has reached its sink, so for
+// async scenarios it includes draining the buffer.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#ifndef WIN32
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+#include "LatencyHistogram.hpp"
+#include "Logger.hpp"
+#include "LogSink.hpp"
+
+namespace {
+using Fetcko::LatencyHistogram;
+using Fetcko::Logger;
+
+#ifdef WIN32
+constexpr const char *NullPath = "NUL";
+#else
+constexpr const char *NullPath = "/dev/null";
+#endif
+
+class BenchObject : public Fetcko::LoggableClass {
+public:
+	BenchObject(std::size_t index) : LoggableClass("bench " + std::to_string(index)) {}
+};
+
+enum class Output {
+	DevNull,	// ConsoleSink, with standard output pointed at /dev/null
+	File,		// ConsoleSink, with standard output pointed at a file
+	MappedFile,	// MappedFileSink
+	Compressed	// CompressedFileSink
+};
+
+struct Scenario {
+	std::string_view name;
+	bool async;
+	Output output;
+
+	// Log at Info with logLevel above it, so
+	// every call is rejected by IsLevelEnabled
+	bool filtered;
+};
+
+constexpr Scenario Scenarios[] = {
+	{ "sync  filtered", false, Output::DevNull, true },
+	{ "sync  console > /dev/null", false, Output::DevNull, false },
+	{ "sync  console > file", false, Output::File, false },
+	{ "sync  mapped file", false, Output::MappedFile, false },
+	{ "async console > /dev/null", true, Output::DevNull, false },
+	{ "async console > file", true, Output::File, false },
+	{ "async mapped file", true, Output::MappedFile, false },
+	{ "async compressed file", true, Output::Compressed, false }
+};
+
+// ConsoleSink writes to file descriptor 1 itself, so pointing
+// std::cout elsewhere isn't enough; the descriptor is swapped
+// for the length of a scenario. On Windows it goes through
+// std::cout, so that's all that's swapped there.
+class StdoutRedirect {
+public:
+	explicit StdoutRedirect(const std::filesystem::path &path) {
+		std::cout.flush();
+		std::fflush(stdout);
+
+#ifdef WIN32
+		file.open(path, std::ios::out | std::ios::trunc);
+		original = std::cout.rdbuf(file.rdbuf());
+#else
+		const auto fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1) return;
+
+		saved = dup(STDOUT_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		close(fd);
+#endif
+	}
+
+	~StdoutRedirect() {
+		std::cout.flush();
+		std::fflush(stdout);
+
+#ifdef WIN32
+		std::cout.rdbuf(original);
+#else
+		if (saved == -1) return;
+
+		dup2(saved, STDOUT_FILENO);
+		close(saved);
+#endif
+	}
+
+private:
+#ifdef WIN32
+	std::ofstream file;
+	std::streambuf *original = nullptr;
+#else
+	int saved = -1;
+#endif
+};
+
+struct Result {
+	double messagesPerSecond = 0;
+	LatencyHistogram::Snapshot latency;
+};
+
+Result Run(const Scenario &scenario, std::size_t threadCount, std::size_t messages) {
+	const auto directory = std::filesystem::temp_directory_path();
+
+	std::unique_ptr<StdoutRedirect> redirect;
+	std::shared_ptr<Fetcko::MappedFileSink> mapped;
+	const auto compressedPath = directory / "Utils_logger_bench.flz";
+
+	Logger::ClearSinks();
+
+	switch (scenario.output) {
+		case Output::DevNull:
+		case Output::File:
+			redirect = std::make_unique<StdoutRedirect>(
+				scenario.output == Output::DevNull ? std::filesystem::path(NullPath) : directory / "Utils_logger_bench.log"
+			);
+			Logger::AddSink(std::make_shared<Fetcko::ConsoleSink>());
+			break;
+
+		case Output::MappedFile:
+			mapped = std::make_shared<Fetcko::MappedFileSink>(
+				Fetcko::MappedFileSink::Options { directory / "Utils_logger_bench_mapped.log" }
+			);
+			Logger::AddSink(mapped);
+			break;
+
+		case Output::Compressed:
+			Logger::AddSink(std::make_shared<Fetcko::CompressedFileSink>(
+				Fetcko::CompressedFileSink::Options { compressedPath }
+			));
+			break;
+	}
+
+	Logger::logLevel = scenario.filtered ? Logger::Level::Warning : Logger::Level::Info;
+
+	if (scenario.async)
+		Logger::StartAsync();
+
+	// Too big for the stack
+	auto histogram = std::make_unique<LatencyHistogram>();
+
+	std::atomic<std::size_t> ready = 0;
+	std::atomic<bool> go = false;
+
+	std::vector<std::thread> threads;
+	for (std::size_t i = 0; i < threadCount; ++i) {
+		threads.emplace_back([&, i] {
+			BenchObject object(i);
+
+			// One of each kind of argument people actually log
+			const std::string text = "a std::string";
+			const std::filesystem::path path = "some/directory/file.txt";
+
+			++ready;
+			while (!go.load(std::memory_order_acquire))
+				std::this_thread::yield();
+
+			for (std::size_t n = 0; n < messages; ++n) {
+				const auto start = std::chrono::steady_clock::now();
+				object.LogInfo("Loaded ", n, " items from ", path, " into ", text, " in ", 2.5, "ms");
+				const auto end = std::chrono::steady_clock::now();
+
+				histogram->Record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+			}
+		});
+	}
+
+	while (ready.load() < threadCount)
+		std::this_thread::yield();
+
+	const auto start = std::chrono::steady_clock::now();
+	go.store(true, std::memory_order_release);
+
+	for (auto &thread : threads)
+		thread.join();
+
+	if (scenario.async)
+		Logger::StopAsync();
+
+	const auto end = std::chrono::steady_clock::now();
+
+	Result ret;
+	ret.latency = histogram->Read();
+	ret.messagesPerSecond = static_cast<double>(threadCount * messages) / std::chrono::duration<double>(end - start).count();
+
+	Logger::ClearSinks();
+	redirect.reset();
+
+	std::error_code error;
+	if (mapped) {
+		// Rotated ones too. The spare segment being
+		// prepared is removed by the sink itself.
+		std::vector<std::filesystem::path> segments;
+		for (const auto index : mapped->FindSegments())
+			segments.push_back(mapped->SegmentPath(index));
+
+		mapped.reset();
+
+		for (const auto &segment : segments)
+			std::filesystem::remove(segment, error);
+	}
+
+	if (scenario.output == Output::Compressed)
+		std::filesystem::remove(compressedPath, error);
+
+	if (scenario.output == Output::File)
+		std::filesystem::remove(directory / "Utils_logger_bench.log", error);
+
+	return ret;
+}
+
+std::size_t ParseCount(const char *text, std::size_t fallback) {
+	char *end = nullptr;
+	const auto value = std::strtoull(text, &end, 10);
+	return end != text && value ? static_cast<std::size_t>(value) : fallback;
+}
+}
+
+int main(int argc, char **argv) {
+	std::size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::size_t messages = 20000;
+
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (std::strcmp(argv[i], "--threads") == 0)
+			maxThreads = ParseCount(argv[i + 1], maxThreads);
+		else if (std::strcmp(argv[i], "--messages") == 0)
+			messages = ParseCount(argv[i + 1], messages);
+	}
+
+	std::vector<std::size_t> threadCounts;
+	for (std::size_t n = 1; n < maxThreads; n *= 2)
+		threadCounts.push_back(n);
+	threadCounts.push_back(maxThreads);
+
+	std::printf("%-28s %7s %12s %9s %9s %9s\n", "scenario", "threads", "msgs/sec", "p50 ns", "p99 ns", "p999 ns");
+
+	for (const auto &scenario : Scenarios) {
+		for (const auto threads : threadCounts) {
+			const auto result = Run(scenario, threads, messages);
+
+			std::printf(
+				"%-28s %7zu %12.0f %9llu %9llu %9llu\n",
+				std::string(scenario.name).c_str(),
+				threads,
+				result.messagesPerSecond,
+				static_cast<unsigned long long>(result.latency.Percentile(0.5)),
+				static_cast<unsigned long long>(result.latency.Percentile(0.99)),
+				static_cast<unsigned long long>(result.latency.Percentile(0.999))
+			);
+			std::fflush(stdout);
+		}
+	}
+
+	Logger::AddSink(std::make_shared<Fetcko::ConsoleSink>());
+
+	return 0;
+}
\ No newline at end of file